@@ -0,0 +1,209 @@
+#include "bench.hpp"
+#include <chrono>
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+#include <algorithm>
+
+
+static size_t lattice_sites(const State& state){
+    size_t res = 1;
+    for (const size_t& n : state.snapshot_shape()){
+        res *= n;
+    }
+    return res;
+}
+
+static double sites_per_step(const std::string& method, const size_t& N){
+    //single-site updates visit one site per step, cluster updates a random number of them (-1), and all other methods sweep the lattice
+    if (method == "ssf"){
+        return 1;
+    }
+    else if (method == "wolff"){
+        return -1;
+    }
+    return N;
+}
+
+static std::string json_number(const double& x){
+    if (x < 0 || !std::isfinite(x)){
+        return "null";
+    }
+    std::ostringstream out;
+    out << std::setprecision(10) << x;
+    return out.str();
+}
+
+std::string BenchResult::json() const{
+    std::ostringstream out;
+    out << "{\"model\": \"" << model << "\", \"method\": \"" << method << "\", \"L\": " << L << ", \"T\": " << json_number(T)
+        << ", \"threads\": " << threads << ", \"sims\": " << sims << ", \"steps\": " << steps << ", \"seconds\": " << json_number(seconds)
+        << ", \"steps_per_sec\": " << json_number(steps_per_sec) << ", \"site_updates_per_sec\": " << json_number(site_updates_per_sec)
+        << ", \"spin_flips_per_sec\": " << json_number(spin_flips_per_sec) << ", \"clusters_per_sec\": " << json_number(clusters_per_sec)
+        << ", \"sweeps_per_sec\": " << json_number(sweeps_per_sec) << ", \"chain_bytes\": " << chain_bytes << ", \"snapshot_bytes\": " << snapshot_bytes << "}";
+    return out.str();
+}
+
+std::string to_json(const std::vector<BenchResult>& results){
+    std::ostringstream out;
+    out << "{\"max_threads\": " << omp_get_max_threads() << ", \"results\": [";
+    for (size_t i=0; i<results.size(); i++){
+        out << (i > 0 ? ",\n  " : "\n  ") << results[i].json();
+    }
+    out << "\n]}";
+    return out.str();
+}
+
+template<class Run>
+static void timed(const double& min_time, size_t& steps, double& seconds, const Run& run){
+    //doubles the number of steps until a single run lasts at least min_time, and keeps the last run
+    for (steps=1; ; steps*=2){
+        const auto t0 = std::chrono::steady_clock::now();
+        run(steps);
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        if (seconds >= min_time){
+            return;
+        }
+    }
+}
+
+BenchResult bench_chain(MarkovChain& chain, const std::string& method, const double& min_time){
+    const UpdateMethod m = chain.method(method);
+    const size_t N = lattice_sites(chain.state());
+    const bool counting = chain.counting();
+    BenchResult res;
+    res.method = method;
+    //only the kernel is timed, with the counters off
+    chain.set_counting(false);
+    timed(min_time, res.steps, res.seconds, [&](const size_t& steps){
+        m.run(chain, steps);
+    });
+    res.steps_per_sec = res.steps/res.seconds;
+    double flips = -1; //per step, from a separate untimed run with the counters on. Metropolis methods count their accepted moves, wolff the sites of its clusters
+    if (MCPY_COUNTERS && method != "sw"){
+        const ChainCounters before = chain.counters();
+        const size_t steps = std::max<size_t>(1, res.steps/8);
+        chain.reset_counters();
+        chain.set_counting(true);
+        m.run(chain, steps);
+        flips = double(method == "wolff" ? chain.counters().cluster_sites : chain.counters().accepted)/steps;
+        chain.counters() = before;
+    }
+    chain.set_counting(counting);
+    const double sites = (method == "wolff") ? flips : sites_per_step(method, N);
+    if (sites > 0){
+        res.site_updates_per_sec = sites*res.steps_per_sec;
+        res.sweeps_per_sec = res.site_updates_per_sec/N;
+    }
+    if (flips >= 0){
+        res.spin_flips_per_sec = flips*res.steps_per_sec;
+    }
+    if (method == "wolff"){
+        res.clusters_per_sec = res.steps_per_sec;
+    }
+    res.chain_bytes = chain.memory();
+    res.snapshot_bytes = chain.state().snapshot_bytes();
+    return res;
+}
+
+BenchResult bench_update_all(const MonteCarlo& prototype, const std::string& method, const int& threads, const double& min_time){
+    std::vector<std::unique_ptr<MonteCarlo>> sims;
+    std::vector<MonteCarlo*> ptrs;
+    for (int i=0; i<threads; i++){
+        sims.push_back(std::make_unique<MonteCarlo>(prototype));
+        sims.back()->set_store_states(false);
+        ptrs.push_back(sims.back().get());
+    }
+    const size_t N = lattice_sites(prototype.chain().state());
+    BenchResult res;
+    res.method = method;
+    res.threads = threads;
+    res.sims = threads;
+    timed(min_time, res.steps, res.seconds, [&](const size_t& steps){
+        update_all(ptrs, method, steps, 0, threads, 1 + steps/16);
+    });
+    res.steps_per_sec = res.sims*res.steps/res.seconds;
+    const double sites = sites_per_step(method, N);
+    if (sites > 0){
+        res.site_updates_per_sec = sites*res.steps_per_sec;
+        res.sweeps_per_sec = res.site_updates_per_sec/N;
+    }
+    if (method == "wolff"){
+        res.clusters_per_sec = res.steps_per_sec;
+    }
+    res.chain_bytes = sims[0]->chain().memory();
+    res.snapshot_bytes = prototype.chain().state().snapshot_bytes();
+    return res;
+}
+
+std::vector<std::string> model_methods(const std::string& model){
+    if (model == "ising2d"){
+        return {"ssf", "wolff", "sw", "checkerboard", "parallel_checkerboard"};
+    }
+    else if (model == "packed"){
+        return {"msc"};
+    }
+    else if (model == "ising3d" || model == "potts3" || model == "xy2d"){
+        return {"ssf", "sweep"};
+    }
+    throw std::runtime_error("Unknown benchmark model \"" + model + "\"");
+}
+
+static std::unique_ptr<MonteCarlo> make_model(const std::string& model, const double& T, const size_t& L){
+    //returns nullptr if the model does not support this lattice size
+    if (model == "ising2d"){
+        return std::make_unique<IsingModel2D>(T, L, L);
+    }
+    else if (model == "packed"){
+        return (L % 64 == 0) ? std::make_unique<PackedIsingModel2D>(T, L, L) : nullptr;
+    }
+    else if (model == "ising3d"){
+        return std::make_unique<Ising3D>(T, std::array<size_t, 3>{L, L, L});
+    }
+    else if (model == "potts3"){
+        return std::make_unique<Potts2D<3>>(T, std::array<size_t, 2>{L, L});
+    }
+    else if (model == "xy2d"){
+        return std::make_unique<XY2D>(T, std::array<size_t, 2>{L, L});
+    }
+    throw std::runtime_error("Unknown benchmark model \"" + model + "\"");
+}
+
+std::vector<BenchResult> run_benchmarks(const BenchConfig& config){
+    if (config.seed != 0){
+        set_global_seed(config.seed);
+    }
+    const std::vector<std::string> methods = config.methods.empty() ? model_methods(config.model) : config.methods;
+    std::vector<BenchResult> results;
+    for (const size_t& L : config.L){
+        for (const double& T : config.T){
+            std::unique_ptr<MonteCarlo> prototype = make_model(config.model, T, L);
+            if (!prototype){
+                continue;
+            }
+            for (const std::string& method : methods){
+                try{
+                    prototype->chain().method(method);
+                }
+                catch (const std::runtime_error&){
+                    continue; //not available for this model or lattice size
+                }
+                for (const int& threads : config.threads){
+                    BenchResult res;
+                    if (threads <= 1){
+                        std::unique_ptr<MarkovChain> chain = prototype->chain().safe_clone();
+                        res = bench_chain(*chain, method, config.min_time);
+                    }
+                    else{
+                        res = bench_update_all(*prototype, method, threads, config.min_time);
+                    }
+                    res.model = config.model;
+                    res.L = L;
+                    res.T = T;
+                    results.push_back(res);
+                }
+            }
+        }
+    }
+    return results;
+}
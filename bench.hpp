@@ -0,0 +1,67 @@
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+#include "msc.hpp"
+#include "lattice.hpp"
+#include <string>
+#include <vector>
+
+struct BenchResult;
+
+struct BenchConfig;
+
+
+struct BenchResult{
+
+    /*
+    Throughput of one update method on one lattice size and temperature.
+    Rates are per second of wall time, summed over all simulations of an update_all run.
+    Quantities that a method does not define (e.g. spin flips of a full sweep) are negative, and written as null in json.
+    */
+
+    std::string model;
+    std::string method;
+    size_t L = 0;
+    double T = 0;
+    int threads = 1;
+    size_t sims = 1; //number of simulations run together by update_all (1: a single chain, without update_all)
+    size_t steps = 0; //steps per simulation
+    double seconds = 0;
+    double steps_per_sec = 0;
+    double site_updates_per_sec = -1; //attempted updates of single sites
+    double spin_flips_per_sec = -1; //spins actually changed (accepted moves, or the sites of the flipped clusters)
+    double clusters_per_sec = -1;
+    double sweeps_per_sec = -1; //site updates per second divided by the number of sites
+    size_t chain_bytes = 0; //memory held by one chain (state and work buffers)
+    size_t snapshot_bytes = 0; //memory of each stored state
+
+    std::string json() const;
+};
+
+
+struct BenchConfig{
+
+    std::string model = "ising2d"; //"ising2d" (IsingModel2D), "packed" (PackedIsingModel2D), "ising3d", "potts3", "xy2d" (lattice models)
+    std::vector<std::string> methods = {}; //empty: all update methods of the model. Methods that the model does not have are skipped
+    std::vector<size_t> L = {16, 32, 64, 128};
+    std::vector<double> T = {2.269};
+    std::vector<int> threads = {1}; //1: a single chain (bench_chain). Thread counts > 1 run one simulation per thread through update_all
+    double min_time = 0.2; //each measurement runs at least this long, doubling its steps until it does
+    uint64_t seed = 0;
+};
+
+
+//a single chain, without measurements. Only L, T, model are left unset.
+//Only the update kernel is timed. The spin flips (all methods but sw) come from the chain counters of a separate untimed run, and are not reported if the counters are compiled out
+BenchResult bench_chain(MarkovChain& chain, const std::string& method, const double& min_time);
+
+BenchResult bench_update_all(const MonteCarlo& prototype, const std::string& method, const int& threads, const double& min_time); //threads copies of prototype through update_all
+
+std::vector<std::string> model_methods(const std::string& model); //update methods benchmarked by default
+
+std::vector<BenchResult> run_benchmarks(const BenchConfig& config);
+
+std::string to_json(const std::vector<BenchResult>& results);
+
+
+#endif
@@ -0,0 +1,68 @@
+#include "bench.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+
+template<class T>
+static std::vector<T> parse_list(const std::string& arg){
+    //comma separated values, e.g. "16,32,64"
+    std::vector<T> res;
+    std::stringstream ss(arg);
+    std::string item;
+    while (std::getline(ss, item, ',')){
+        std::stringstream is(item);
+        T x;
+        if (!(is >> x)){
+            throw std::runtime_error("Invalid value \"" + item + "\"");
+        }
+        res.push_back(x);
+    }
+    return res;
+}
+
+static void usage(){
+    std::cerr << "usage: bench [--model ising2d|packed|ising3d|potts3|xy2d] [--methods ssf,wolff,... (default: all)] [--L 16,32,...] [--T 2.269,...]\n"
+              << "             [--threads 1,2,...] [--min-time seconds] [--seed n] [--out file.json]\n";
+}
+
+int main(int argc, char** argv){
+    BenchConfig config;
+    std::string out;
+    try{
+        for (int i=1; i<argc; i++){
+            const std::string opt = argv[i];
+            if (opt == "-h" || opt == "--help"){
+                usage();
+                return 0;
+            }
+            if (i+1 >= argc){
+                throw std::runtime_error("Missing value for " + opt);
+            }
+            const std::string val = argv[++i];
+            if (opt == "--model") config.model = val;
+            else if (opt == "--methods") config.methods = parse_list<std::string>(val);
+            else if (opt == "--L") config.L = parse_list<size_t>(val);
+            else if (opt == "--T") config.T = parse_list<double>(val);
+            else if (opt == "--threads") config.threads = parse_list<int>(val);
+            else if (opt == "--min-time") config.min_time = std::stod(val);
+            else if (opt == "--seed") config.seed = std::stoull(val);
+            else if (opt == "--out") out = val;
+            else throw std::runtime_error("Unknown option " + opt);
+        }
+        const std::string json = to_json(run_benchmarks(config));
+        if (out.empty()){
+            std::cout << json << std::endl;
+        }
+        else{
+            std::ofstream file(out);
+            file << json << std::endl;
+        }
+    }
+    catch (const std::exception& e){
+        std::cerr << "bench: " << e.what() << std::endl;
+        usage();
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include "io.hpp"
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+
+void BinaryWriter::write_bytes(const void* data, const size_t& bytes){
+    _out.write(static_cast<const char*>(data), bytes);
+    if (!_out){
+        throw std::runtime_error("Failed to write checkpoint data");
+    }
+}
+
+void BinaryReader::read_bytes(void* data, const size_t& bytes){
+    _in.read(static_cast<char*>(data), bytes);
+    if (size_t(_in.gcount()) != bytes){
+        throw std::runtime_error("Unexpected end of checkpoint data");
+    }
+}
+
+void BinaryReader::expect(const std::string& tag){
+    const std::string found = this->read_string();
+    if (found != tag){
+        throw std::runtime_error("Corrupted or incompatible checkpoint: expected \"" + tag + "\", found \"" + found + "\"");
+    }
+}
+
+size_t BinaryReader::_read_size(const size_t& itemsize){
+    const uint64_t n = this->read<uint64_t>();
+    //a corrupted size should fail here, and not in an attempt to allocate an enormous vector
+    const std::streampos pos = _in.tellg();
+    if (pos != std::streampos(-1)){
+        _in.seekg(0, std::ios::end);
+        const std::streamoff left = _in.tellg() - pos;
+        _in.seekg(pos);
+        if (itemsize > 0 && n > uint64_t(left)/itemsize){
+            throw std::runtime_error("Unexpected end of checkpoint data");
+        }
+    }
+    return n;
+}
+
+
+MappedFile::MappedFile(const std::string& path, const Mode& mode) : _path(std::filesystem::absolute(path).string()), _mode(mode){
+    if (mode == Mode::Create){
+        //unlinking keeps the old file (and any mapping of it) intact, instead of truncating it under the mappings
+        ::unlink(_path.c_str());
+        _fd = ::open(_path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    }
+    else{
+        _fd = ::open(_path.c_str(), (mode == Mode::Read) ? O_RDONLY : O_RDWR);
+    }
+    if (_fd < 0){
+        throw std::runtime_error("Could not open file \"" + _path + "\"");
+    }
+    if (mode != Mode::Read && ::flock(_fd, LOCK_EX | LOCK_NB) != 0){
+        ::close(_fd);
+        throw std::runtime_error("File \"" + _path + "\" is already being written");
+    }
+    _final_size = this->size();
+}
+
+MappedFile::~MappedFile(){
+    if (!this->read_only()){
+        [[maybe_unused]] const int err = ::ftruncate(_fd, _final_size); //on failure the file is only longer than needed
+    }
+    ::close(_fd);
+}
+
+std::shared_ptr<char[]> MappedFile::map(const size_t& bytes){
+    if (bytes > this->size()){
+        if (this->read_only()){
+            throw std::runtime_error("File \"" + _path + "\" is shorter than expected");
+        }
+        if (::ftruncate(_fd, bytes) != 0){
+            throw std::runtime_error("Could not extend file \"" + _path + "\"");
+        }
+    }
+    const size_t len = std::max<size_t>(bytes, 1);
+    void* ptr = ::mmap(nullptr, len, this->read_only() ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (ptr == MAP_FAILED){
+        throw std::runtime_error("Could not map file \"" + _path + "\"");
+    }
+    return std::shared_ptr<char[]>(static_cast<char*>(ptr), [len](char* p){ ::munmap(p, len);});
+}
+
+bool MappedFile::in_use(const std::string& path){
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0){
+        return false;
+    }
+    const bool res = (::flock(fd, LOCK_SH | LOCK_NB) != 0);
+    ::close(fd); //also releases the lock, if it was taken
+    return res;
+}
+
+size_t MappedFile::size() const{
+    struct stat st;
+    if (::fstat(_fd, &st) != 0){
+        throw std::runtime_error("Could not read the size of file \"" + _path + "\"");
+    }
+    return st.st_size;
+}
@@ -0,0 +1,141 @@
+#ifndef IO_HPP
+#define IO_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <type_traits>
+
+class BinaryWriter;
+
+class BinaryReader;
+
+class MappedFile;
+
+
+class BinaryWriter{
+
+    /*
+    Writes plain values in native byte order, used by the checkpoints.
+    Every field is written as it is in memory, vectors and strings are preceded by their size.
+    */
+
+public:
+
+    BinaryWriter(std::ostream& out):_out(out){}
+
+    void write_bytes(const void* data, const size_t& bytes);
+
+    template<class T>
+    inline void write(const T& x){
+        static_assert(std::is_trivially_copyable_v<T>);
+        this->write_bytes(&x, sizeof(T));
+    }
+
+    template<class T>
+    inline void write_vector(const std::vector<T>& x){
+        this->write<uint64_t>(x.size());
+        this->write_bytes(x.data(), x.size()*sizeof(T));
+    }
+
+    inline void write_string(const std::string& s){
+        this->write<uint64_t>(s.size());
+        this->write_bytes(s.data(), s.size());
+    }
+
+private:
+    std::ostream& _out;
+};
+
+
+class BinaryReader{
+
+    //Reads what a BinaryWriter has written, in the same order. Throws if the stream ends early.
+
+public:
+
+    BinaryReader(std::istream& in):_in(in){}
+
+    void read_bytes(void* data, const size_t& bytes);
+
+    template<class T>
+    inline T read(){
+        static_assert(std::is_trivially_copyable_v<T>);
+        T res;
+        this->read_bytes(&res, sizeof(T));
+        return res;
+    }
+
+    template<class T>
+    inline std::vector<T> read_vector(){
+        std::vector<T> res(this->_read_size(sizeof(T)));
+        this->read_bytes(res.data(), res.size()*sizeof(T));
+        return res;
+    }
+
+    inline std::string read_string(){
+        std::string res(this->_read_size(1), '\0');
+        this->read_bytes(res.data(), res.size());
+        return res;
+    }
+
+    void expect(const std::string& tag); //reads a string, and throws if it is not equal to tag
+
+private:
+    std::istream& _in;
+
+    size_t _read_size(const size_t& itemsize); //reads the size of a vector, and checks that the stream can hold it
+};
+
+
+class MappedFile{
+
+    /*
+    File that is accessed through shared memory mappings (POSIX mmap).
+    map() extends the file if needed and maps all of it. A new mapping does not invalidate the previous ones,
+    and each mapping is released when the last copy of its pointer is destroyed.
+    The file is truncated to final_size() when the object is destroyed, so unused preallocated space is not left behind.
+    A file opened with Mode::Read is never modified: it is mapped read-only, cannot be extended, and keeps its size.
+    The other modes hold an exclusive advisory lock (flock) on the file, so that at most one object (of any process) writes it.
+    */
+
+public:
+
+    enum class Mode{Create, Append, Read}; //Create: a new empty file replaces the file at path (existing mappings of the old file are not affected)
+
+    MappedFile(const std::string& path, const Mode& mode);
+
+    MappedFile(const MappedFile&) = delete;
+
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile();
+
+    std::shared_ptr<char[]> map(const size_t& bytes);
+
+    size_t size() const; //current size of the file in bytes
+
+    static bool in_use(const std::string& path); //true if a MappedFile that is not read-only holds the file at path
+
+    inline const std::string& path() const{ return _path;}
+
+    inline void set_final_size(const size_t& bytes){ _final_size = bytes;}
+
+    inline const size_t& final_size() const{ return _final_size;}
+
+    inline bool read_only() const{ return _mode == Mode::Read;}
+
+private:
+    std::string _path;
+    Mode _mode;
+    int _fd = -1;
+    size_t _final_size = 0;
+};
+
+
+#endif
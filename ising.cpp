@@ -1,13 +1,10 @@
 #include "ising.hpp"
 
 
-std::vector<int> random_spins(const size_t& Lx, const size_t& Ly){
+std::vector<int> random_spins(const size_t& Lx, const size_t& Ly, Philox& gen){
     std::vector<int> spins(Lx*Ly);
-    std::mt19937 gen(std::random_device{}());
-    std::uniform_int_distribution<int> dist(0, 1); // generates 0 or 1
-
     for (int& s : spins) {
-        s = dist(gen) ? 1 : -1;
+        s = (gen() & 1) ? 1 : -1;
     }
     return spins;
 }
@@ -38,15 +35,64 @@ double SpinState::M()const{
 }
 
 double SpinState::energy() const{
-    long int res = 0;
+    return this->energy(1, 1, 0);
+}
+
+double SpinState::energy(const double& Jx, const double& Jy, const double& h) const{
+    long int Ex = 0, Ey = 0;
     const SpinState& s = *this;
 
     for (size_t i=0; i<shape[0]; i++){
         for (size_t j=0; j<shape[1]; j++){
-            res -= s(i, j)*(s(i-1, j) + s(i, j-1));
+            Ex -= s(i, j)*s(i-1, j);
+            Ey -= s(i, j)*s(i, j-1);
         }
     }
-    return res;
+    return Jx*Ex + Jy*Ey - h*this->M();
+}
+
+double SpinState::structure_factor(const size_t& nx, const size_t& ny) const{
+    const size_t Lx = shape[0];
+    const int* s = spins.data();
+    return lattice_structure_factor(Lx, shape[1], nx, ny, [s, Lx](const size_t& i, const size_t& j){return s[j*Lx+i];});
+}
+
+void SpinState::snapshot(void* out) const{
+    int8_t* res = static_cast<int8_t*>(out);
+    for (size_t k=0; k<spins.size(); k++){
+        res[k] = spins[k];
+    }
+}
+
+void SpinState::save(BinaryWriter& out) const{
+    std::vector<uint64_t> words((spins.size()+63)/64, 0);
+    for (size_t k=0; k<spins.size(); k++){
+        if (spins[k] > 0){
+            words[k/64] |= uint64_t(1) << (k % 64);
+        }
+    }
+    out.write(shape);
+    out.write_vector(words);
+}
+
+void SpinState::load(BinaryReader& in){
+    const std::array<size_t, 2> new_shape = in.read<std::array<size_t, 2>>();
+    const std::vector<uint64_t> words = in.read_vector<uint64_t>();
+    if (words.size() != (new_shape[0]*new_shape[1]+63)/64){
+        throw std::runtime_error("Corrupted spin state in checkpoint");
+    }
+    shape = new_shape;
+    spins.resize(shape[0]*shape[1]);
+    for (size_t k=0; k<spins.size(); k++){
+        spins[k] = ((words[k/64] >> (k % 64)) & 1) ? 1 : -1;
+    }
+}
+
+void SpinState::load_snapshot(const void* in){
+    const int8_t* data = static_cast<const int8_t*>(in);
+    for (size_t k=0; k<spins.size(); k++){
+        spins[k] = data[k];
+    }
 }
 
 std::vector<size_t> SpinState::neighbors(const size_t& site){
@@ -63,45 +109,440 @@ size_t SpinState::index(long int i, long int j) const{
 
 
 void IsingModel2DMarkovChain::ssf_update(){
+    //one raw random number against the tabulated threshold, instead of exp(-dE/T) and a uniform double
     SpinState& S = static_cast<SpinState&>(*this->_state);
-    size_t k = this->_choose_site();
-    size_t i = k % S.shape[0];
-    size_t j = k/S.shape[0];
-    double de = 2*S(k)*(S(i-1, j)+S(i+1, j)+S(i, j-1)+S(i, j+1));
-    if (this->draw_uniform(0, 1) <= exp(-de/_T)){
-        S.spins[k] *= -1;
+    int* spins = S.spins.data();
+    const size_t k = this->_choose_site();
+    const int s = spins[k];
+    const auto [hx, hy] = S.local_field(k);
+    const bool accept = (this->_gen() < _threshold[_lut(s, hx, hy)]);
+    if (accept){
+        _Ex += 2*s*hx;
+        _Ey += 2*s*hy;
+        _M -= 2*s;
+        spins[k] = -s;
+    }
+    if (this->counting()){
+        _counters.proposals++;
+        _counters.accepted += accept;
     }
 }
 
 void IsingModel2DMarkovChain::wolff_update(){
+    SpinState& S = static_cast<SpinState&>(*this->_state);
+    const size_t Lx = S.shape[0], Ly = S.shape[1];
+    int* spins = S.spins.data();
     size_t site = _choose_site();
+    const int s = spins[site];
+
+    //sites are flipped as soon as they join the cluster, so the flipped spin itself marks membership
+    //_cluster_stack holds the whole cluster, and the sites from "next" onwards still need their neighbors checked. Its capacity is reserved once, so no allocations happen here
+    _cluster_stack.clear();
+    _cluster_stack.push_back(site);
+    spins[site] = -s;
+    for (size_t next=0; next<_cluster_stack.size(); next++){
+        site = _cluster_stack[next];
+        const size_t i = site % Lx, j = site / Lx;
+        const size_t neighbors[4] = {j*Lx + (i+Lx-1)%Lx, j*Lx + (i+1)%Lx, ((j+Ly-1)%Ly)*Lx + i, ((j+1)%Ly)*Lx + i};
+        for (size_t n=0; n<4; n++){
+            const size_t nr = neighbors[n];
+            if ( (spins[nr] == s ) && (this->draw_uniform(0, 1) < (n < 2 ? _bond_prob_x : _bond_prob_y))){
+                spins[nr] = -s;
+                _cluster_stack.push_back(nr);
+            }
+        }
+    }
+
+    //only the bonds on the surface of the cluster change. Each one costs 2*s*s_nr, where s_nr is the (unflipped) outer spin
+    uint8_t* in_cluster = _in_cluster.data();
+    for (const size_t& k : _cluster_stack){
+        in_cluster[k] = 1;
+    }
+    long int dx = 0, dy = 0;
+    for (const size_t& k : _cluster_stack){
+        const size_t i = k % Lx, j = k / Lx;
+        const size_t left = j*Lx + (i+Lx-1)%Lx, right = j*Lx + (i+1)%Lx, up = ((j+Ly-1)%Ly)*Lx + i, down = ((j+1)%Ly)*Lx + i;
+        dx += (in_cluster[left] ? 0 : 2*s*spins[left]) + (in_cluster[right] ? 0 : 2*s*spins[right]);
+        dy += (in_cluster[up] ? 0 : 2*s*spins[up]) + (in_cluster[down] ? 0 : 2*s*spins[down]);
+    }
+    for (const size_t& k : _cluster_stack){
+        in_cluster[k] = 0;
+    }
+    _Ex += dx;
+    _Ey += dy;
+    _M -= 2*s*long(_cluster_stack.size());
+    if (this->counting()){
+        _counters.add_cluster(_cluster_stack.size());
+    }
+}
+
+static size_t uf_find(size_t* parent, size_t k){
+    //path halving. Parents always have a smaller index than their children, so concurrent updates cannot create cycles
+    while (true){
+        std::atomic_ref<size_t> pk(parent[k]);
+        size_t p = pk.load(std::memory_order_relaxed);
+        if (p == k){
+            return k;
+        }
+        const size_t gp = std::atomic_ref<size_t>(parent[p]).load(std::memory_order_relaxed);
+        if (gp != p){
+            pk.compare_exchange_weak(p, gp, std::memory_order_relaxed);
+        }
+        k = gp;
+    }
+}
+
+static void uf_unite(size_t* parent, size_t a, size_t b){
+    //lock-free union: the root with the larger index is attached to the other one, retrying if another thread got there first
+    while (true){
+        a = uf_find(parent, a);
+        b = uf_find(parent, b);
+        if (a == b){
+            return;
+        }
+        if (a < b){
+            std::swap(a, b);
+        }
+        size_t expected = a;
+        if (std::atomic_ref<size_t>(parent[a]).compare_exchange_strong(expected, b)){
+            return;
+        }
+    }
+}
+
+void IsingModel2DMarkovChain::sw_update(){
     SpinState& S = static_cast<SpinState&>(*this->_state);
-    const int s = S(site);
-    const double p = 1-std::exp(-2/_T);
-    std::vector<size_t> remaining = {site}; //container with sites whose neighbors we need to check
-
-    S(site) = -s;
-    size_t cluster_size = 1;
-    while (remaining.size()>0){
-        site = remaining.back(); remaining.pop_back();
-        for (const size_t& nr : S.neighbors(site)){
-            if ( (S(nr) == s ) && (this->draw_uniform(0, 1) < p)){
-                S(nr) = -s;
-                remaining.push_back(nr);
-                cluster_size++;
+    const size_t Lx = S.shape[0], Ly = S.shape[1], N = Lx*Ly;
+    const size_t strips = _strip_gen.size();
+    int* spins = S.spins.data();
+    size_t* parent = _parent.data();
+    uint8_t* flip = _flip_cluster.data();
+
+    long int Ex = 0, Ey = 0, M = 0;
+    #pragma omp parallel num_threads(strips)
+    {
+        #pragma omp for schedule(static)
+        for (size_t k=0; k<N; k++){
+            parent[k] = k;
+        }
+
+        //activate the right and down bond of every site, drawing all bond probabilities of a row at once
+        #pragma omp for schedule(static, 1)
+        for (size_t strip=0; strip<strips; strip++){
+            double* r = _strip_buffer[strip].data();
+            for (size_t j=strip*Ly/strips; j<(strip+1)*Ly/strips; j++){
+                _strip_gen[strip].fill_uniform(r, 2*Lx);
+                for (size_t i=0; i<Lx; i++){
+                    const size_t k = j*Lx + i, right = j*Lx + (i+1)%Lx, down = ((j+1)%Ly)*Lx + i;
+                    if (spins[k] == spins[right] && r[2*i] < _bond_prob_x){
+                        uf_unite(parent, k, right);
+                    }
+                    if (spins[k] == spins[down] && r[2*i+1] < _bond_prob_y){
+                        uf_unite(parent, k, down);
+                    }
+                }
+                //coin of each site. Only the coins of the cluster roots are used
+                for (size_t i=0; i<Lx; i++){
+                    flip[j*Lx + i] = _strip_gen[strip]() & 1;
+                }
             }
         }
+
+        #pragma omp for schedule(static)
+        for (size_t k=0; k<N; k++){
+            if (flip[uf_find(parent, k)]){
+                spins[k] = -spins[k];
+            }
+        }
+
+        //the whole lattice has changed anyway, so the bond sums and magnetization are simply recounted
+        #pragma omp for schedule(static) reduction(+:Ex, Ey, M)
+        for (size_t j=0; j<Ly; j++){
+            const int* row = spins + j*Lx;
+            const int* down = spins + ((j+1)%Ly)*Lx;
+            for (size_t i=0; i<Lx; i++){
+                Ex -= row[i]*row[(i+1)%Lx];
+                Ey -= row[i]*down[i];
+                M += row[i];
+            }
+        }
+    }
+    _Ex = Ex;
+    _Ey = Ey;
+    _M = M;
+    if (this->counting()){
+        _count_clusters();
     }
 }
 
-propagator IsingModel2DMarkovChain::method(const std::string& name) const {
+void IsingModel2DMarkovChain::_count_clusters(){
+    //sizes of the clusters of the last sw_update, accumulated on their roots. _cluster_stack has capacity N, so it is borrowed for the counts
+    const size_t N = _parent.size();
+    size_t* parent = _parent.data();
+    _cluster_stack.assign(N, 0);
+    for (size_t k=0; k<N; k++){
+        _cluster_stack[uf_find(parent, k)]++;
+    }
+    for (const size_t& size : _cluster_stack){
+        if (size > 0){
+            _counters.add_cluster(size);
+        }
+    }
+    _cluster_stack.clear();
+}
+
+template<bool Count>
+static inline void metropolis_site(int* row, const size_t& i, const int& hx, const int& hy, const double& r, const double* acceptance, long int& dEx, long int& dEy, long int& dM, long int& flips){
+    //hx, hy: sums of the horizontal and vertical neighbors. acceptance is indexed as IsingModel2DMarkovChain::_lut
+    const int s = row[i];
+    const bool flip = (r < acceptance[(9*s + 3*hx + hy + 17) >> 1]);
+    dEx += flip ? 2*s*hx : 0;
+    dEy += flip ? 2*s*hy : 0;
+    dM -= flip ? 2*s : 0;
+    if constexpr (Count){
+        flips += flip;
+    }
+    row[i] *= flip ? -1 : 1;
+}
+
+template<bool Count>
+static void metropolis_row(int* row, const int* up, const int* down, const size_t& Lx, const size_t& i0, const double* r, const double* acceptance, long int& dEx, long int& dEy, long int& dM, long int& flips){
+    //updates the sites i0, i0+2, ..., of a single row, and adds the change of the bond sums and magnetization to dEx, dEy, dM (and the number of flips to flips if Count).
+    //Only the first and the last site need periodic wrapping,
+    //all sites in between are processed in a branch-free loop that the compiler can vectorize.
+    const size_t n = Lx/2;
+    const size_t first = i0, last = i0 + Lx - 2;
+    metropolis_site<Count>(row, first, row[(first+Lx-1)%Lx] + row[(first+1)%Lx], up[first] + down[first], r[0], acceptance, dEx, dEy, dM, flips);
+
+    long int dex = 0, dey = 0, dm = 0, f = 0;
+    #pragma omp simd reduction(+:dex, dey, dm, f)
+    for (size_t k=1; k<n-1; k++){
+        const size_t i = i0 + 2*k;
+        metropolis_site<Count>(row, i, row[i-1] + row[i+1], up[i] + down[i], r[k], acceptance, dex, dey, dm, f);
+    }
+    dEx += dex;
+    dEy += dey;
+    dM += dm;
+    flips += f;
+
+    if (n > 1){
+        metropolis_site<Count>(row, last, row[last-1] + row[(last+1)%Lx], up[last] + down[last], r[n-1], acceptance, dEx, dEy, dM, flips);
+    }
+}
+
+void IsingModel2DMarkovChain::checkerboard_update(){
+    SpinState& S = static_cast<SpinState&>(*this->_state);
+    const size_t Lx = S.shape[0], Ly = S.shape[1];
+    int* s = S.spins.data();
+    const bool count = this->counting();
+    long int flips = 0;
+    for (size_t color=0; color<2; color++){
+        for (size_t j=0; j<Ly; j++){
+            this->fill_uniform(_rand_buffer.data(), Lx/2);
+            if (count){
+                metropolis_row<true>(s + j*Lx, s + ((j+Ly-1)%Ly)*Lx, s + ((j+1)%Ly)*Lx, Lx, (j+color)%2, _rand_buffer.data(), _acceptance.data(), _Ex, _Ey, _M, flips);
+            }
+            else{
+                metropolis_row<false>(s + j*Lx, s + ((j+Ly-1)%Ly)*Lx, s + ((j+1)%Ly)*Lx, Lx, (j+color)%2, _rand_buffer.data(), _acceptance.data(), _Ex, _Ey, _M, flips);
+            }
+        }
+    }
+    if (count){
+        _counters.proposals += Lx*Ly;
+        _counters.accepted += flips;
+    }
+}
+
+void IsingModel2DMarkovChain::parallel_checkerboard_update(){
+    SpinState& S = static_cast<SpinState&>(*this->_state);
+    const size_t Lx = S.shape[0], Ly = S.shape[1];
+    const size_t strips = _strip_gen.size();
+    int* s = S.spins.data();
+
+    //Rows of the same color never interact, so the strips only need to synchronize between the two half-sweeps.
+    //The boundary rows of a strip are read directly from the neighboring strips, which are not modified during that half-sweep.
+    const bool count = this->counting();
+    long int dEx = 0, dEy = 0, dM = 0, flips = 0;
+    #pragma omp parallel num_threads(strips)
+    for (size_t color=0; color<2; color++){
+        #pragma omp for schedule(static, 1) reduction(+:dEx, dEy, dM, flips)
+        for (size_t strip=0; strip<strips; strip++){
+            double* r = _strip_buffer[strip].data();
+            for (size_t j=strip*Ly/strips; j<(strip+1)*Ly/strips; j++){
+                _strip_gen[strip].fill_uniform(r, Lx/2);
+                if (count){
+                    metropolis_row<true>(s + j*Lx, s + ((j+Ly-1)%Ly)*Lx, s + ((j+1)%Ly)*Lx, Lx, (j+color)%2, r, _acceptance.data(), dEx, dEy, dM, flips);
+                }
+                else{
+                    metropolis_row<false>(s + j*Lx, s + ((j+Ly-1)%Ly)*Lx, s + ((j+1)%Ly)*Lx, Lx, (j+color)%2, r, _acceptance.data(), dEx, dEy, dM, flips);
+                }
+            }
+        }
+    }
+    _Ex += dEx;
+    _Ey += dEy;
+    _M += dM;
+    if (count){
+        _counters.proposals += Lx*Ly;
+        _counters.accepted += flips;
+    }
+}
+
+void IsingModel2DMarkovChain::set_threads(int threads){
+    const SpinState& S = this->ising_state();
+    threads = (threads <= 0) ? omp_get_max_threads() : threads;
+    const size_t strips = std::min(size_t(threads), S.shape[1]);
+    _strip_gen.clear();
+    for (size_t i=0; i<strips; i++){
+        _strip_gen.push_back(this->_gen.substream(i+1));
+    }
+    _strip_buffer.assign(strips, std::vector<double>(2*S.shape[0]));
+}
+
+void IsingModel2DMarkovChain::seed(const uint64_t& seed, const uint64_t& stream){
+    MarkovChain::seed(seed, stream);
+    this->set_threads(this->threads());
+}
+
+void IsingModel2DMarkovChain::save(BinaryWriter& out) const{
+    out.write_string("IsingModel2DMarkovChain");
+    MarkovChain::save(out);
+    out.write(_T);
+    out.write(_Jx);
+    out.write(_Jy);
+    out.write(_h);
+    out.write<uint64_t>(_strip_gen.size());
+    for (const Philox& gen : _strip_gen){
+        save_rng(out, gen);
+    }
+}
+
+void IsingModel2DMarkovChain::load(BinaryReader& in){
+    in.expect("IsingModel2DMarkovChain");
+    MarkovChain::load(in);
+    _T = in.read<double>();
+    _Jx = in.read<double>();
+    _Jy = in.read<double>();
+    _h = in.read<double>();
+    _set_acceptance();
+    _allocate();
+    _recompute();
+    const size_t strips = in.read<uint64_t>();
+    _strip_gen.clear();
+    for (size_t i=0; i<strips; i++){
+        _strip_gen.push_back(load_rng(in));
+    }
+    _strip_buffer.assign(strips, std::vector<double>(2*this->ising_state().shape[0]));
+}
+
+size_t IsingModel2DMarkovChain::memory() const{
+    size_t res = this->ising_state().spins.capacity()*sizeof(int) + _rand_buffer.capacity()*sizeof(double);
+    res += _cluster_stack.capacity()*sizeof(size_t) + _parent.capacity()*sizeof(size_t) + _flip_cluster.capacity() + _in_cluster.capacity();
+    for (const std::vector<double>& buffer : _strip_buffer){
+        res += buffer.capacity()*sizeof(double);
+    }
+    return res;
+}
+
+void IsingModel2DMarkovChain::_allocate(){
+    const SpinState& S = this->ising_state();
+    const size_t N = S.sites();
+    _spin_roulette = std::uniform_int_distribution<size_t>(0, N-1);
+    _rand_buffer.assign(S.shape[0]/2+1, 0);
+    _parent.assign(N, 0);
+    _flip_cluster.assign(N, 0);
+    _in_cluster.assign(N, 0);
+    _cluster_stack.reserve(N);
+}
+
+void IsingModel2DMarkovChain::_recompute(){
+    const SpinState& S = this->ising_state();
+    const size_t Lx = S.shape[0], Ly = S.shape[1];
+    const int* s = S.spins.data();
+    _Ex = _Ey = 0;
+    for (size_t j=0; j<Ly; j++){
+        for (size_t i=0; i<Lx; i++){
+            _Ex -= s[j*Lx + i]*s[j*Lx + (i+1)%Lx];
+            _Ey -= s[j*Lx + i]*s[((j+1)%Ly)*Lx + i];
+        }
+    }
+    _M = S.M();
+}
+
+void IsingModel2DMarkovChain::_set_acceptance(){
+    for (int s : {-1, 1}){
+        for (int hx=-2; hx<=2; hx+=2){
+            for (int hy=-2; hy<=2; hy+=2){
+                const double p = std::min(1., std::exp(-2*s*(_Jx*hx + _Jy*hy + _h)/_T));
+                _acceptance[_lut(s, hx, hy)] = p;
+                _threshold[_lut(s, hx, hy)] = acceptance_threshold(p);
+            }
+        }
+    }
+    _bond_prob_x = 1-std::exp(-2*_Jx/_T);
+    _bond_prob_y = 1-std::exp(-2*_Jy/_T);
+}
+
+UpdateMethod IsingModel2DMarkovChain::method(const std::string& name) const {
     if (name == "ssf"){
-        return static_cast<propagator>(&IsingModel2DMarkovChain::ssf_update);
+        return static_method<IsingModel2DMarkovChain, &IsingModel2DMarkovChain::ssf_update>();
     }
-    else if (name == "wolff"){
-        return static_cast<propagator>(&IsingModel2DMarkovChain::wolff_update);
+    else if (name == "wolff" || name == "sw"){
+        if (_h != 0 || _Jx < 0 || _Jy < 0){
+            throw std::runtime_error("The cluster updates require h = 0 and non negative couplings");
+        }
+        if (name == "wolff"){
+            return static_method<IsingModel2DMarkovChain, &IsingModel2DMarkovChain::wolff_update>();
+        }
+        return static_method<IsingModel2DMarkovChain, &IsingModel2DMarkovChain::sw_update>();
+    }
+    else if (name == "checkerboard" || name == "parallel_checkerboard"){
+        const SpinState& S = this->ising_state();
+        if (S.shape[0] % 2 != 0 || S.shape[1] % 2 != 0){
+            throw std::runtime_error("The checkerboard update requires even lattice dimensions");
+        }
+        if (name == "checkerboard"){
+            return static_method<IsingModel2DMarkovChain, &IsingModel2DMarkovChain::checkerboard_update>();
+        }
+        return static_method<IsingModel2DMarkovChain, &IsingModel2DMarkovChain::parallel_checkerboard_update>();
     }
     else{
-        throw std::runtime_error("");
+        throw std::runtime_error("Unknown update method \"" + name + "\"");
     }
 }
+
+
+void IsingModel2DMarkovChain::exchange_configuration(IsingModel2DMarkovChain& other){
+    SpinState& a = static_cast<SpinState&>(*this->_state);
+    SpinState& b = static_cast<SpinState&>(*other._state);
+    if (a.shape != b.shape){
+        throw std::runtime_error("Only chains of the same lattice size can exchange their configurations");
+    }
+    //the spins are swapped and not the state objects, so that views of each state keep following their own chain
+    std::swap_ranges(a.spins.begin(), a.spins.end(), b.spins.begin());
+    std::swap(_Ex, other._Ex);
+    std::swap(_Ey, other._Ey);
+    std::swap(_M, other._M);
+    std::swap(this->_gen, other._gen);
+    std::swap(_strip_gen, other._strip_gen);
+    std::swap(_strip_buffer, other._strip_buffer);
+}
+
+void IsingModel2D::exchange_chain(IsingModel2D& other){
+    this->_chain().exchange_configuration(other._chain());
+}
+
+ChainObservable IsingModel2D::_builtin_chain_observable(const std::string& name) const{
+    ChainObservable res = chain_observable<IsingModel2DMarkovChain>(name);
+    return res ? res : MonteCarlo::_builtin_chain_observable(name);
+}
+
+Observable IsingModel2D::_builtin_observable(const std::string& name) const{
+    if (name == "energy"){
+        //the stored states do not know the couplings and the field, so the current ones are captured
+        const double Jx = this->chain().Jx(), Jy = this->chain().Jy(), h = this->chain().h();
+        return [Jx, Jy, h](const State& s){return static_cast<const SpinState&>(s).energy(Jx, Jy, h);};
+    }
+    Observable res = spin_observable<SpinState>(name);
+    return res ? res : MonteCarlo::_builtin_observable(name);
+}
\ No newline at end of file
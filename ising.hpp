@@ -2,6 +2,7 @@
 #define ISING_HPP
 
 #include "mc.hpp"
+#include <array>
 
 struct SpinState;
 
@@ -9,7 +10,68 @@ class IsingModel2DMarkovChain;
 
 class IsingModel2D;
 
-std::vector<int> random_spins(const size_t& Lx, const size_t& Ly);
+std::vector<int> random_spins(const size_t& Lx, const size_t& Ly, Philox& gen);
+
+template<class SpinStateType>
+Observable spin_observable(const std::string& name){
+    //built-in observables of any spin state that provides energy(), M() and structure_factor(). Returns an empty function if the name is unknown.
+    if (name == "energy"){
+        return [](const State& s){return static_cast<const SpinStateType&>(s).energy();};
+    }
+    else if (name == "M"){
+        return [](const State& s){return static_cast<const SpinStateType&>(s).M();};
+    }
+    else if (name == "|M|"){
+        return [](const State& s){return std::abs(static_cast<const SpinStateType&>(s).M());};
+    }
+    else if (name == "M^2"){
+        return [](const State& s){return pow(static_cast<const SpinStateType&>(s).M(), 2);};
+    }
+    else if (name == "structure_factor"){
+        return [](const State& s){return static_cast<const SpinStateType&>(s).structure_factor(1, 0);};
+    }
+    return nullptr;
+}
+
+
+template<class Spin>
+double lattice_structure_factor(const size_t& Lx, const size_t& Ly, const size_t& nx, const size_t& ny, const Spin& spin){
+    //|sum_r s_r exp(iq*r)|^2 / N for any 2D lattice, given spin(i, j). The phases are kept in per-thread buffers, so that parallel sampling does not allocate on every call
+    thread_local std::vector<double> cx, sx;
+    cx.resize(Lx);
+    sx.resize(Lx);
+    for (size_t i=0; i<Lx; i++){
+        cx[i] = std::cos(2*M_PI*nx*i/Lx);
+        sx[i] = std::sin(2*M_PI*nx*i/Lx);
+    }
+    double re = 0, im = 0;
+    for (size_t j=0; j<Ly; j++){
+        //row sum, then the phase of the row
+        double row_re = 0, row_im = 0;
+        for (size_t i=0; i<Lx; i++){
+            const int s = spin(i, j);
+            row_re += s*cx[i];
+            row_im += s*sx[i];
+        }
+        const double c = std::cos(2*M_PI*ny*j/Ly), s = std::sin(2*M_PI*ny*j/Ly);
+        re += row_re*c - row_im*s;
+        im += row_re*s + row_im*c;
+    }
+    return (re*re + im*im)/(Lx*Ly);
+}
+
+template<class ChainType>
+ChainObservable chain_observable(const std::string& name){
+    //built-in observables of any chain that keeps its running energy() and magnetization(), evaluated in O(1) (see ChainQuantity). Returns an empty function if the name is unknown.
+    const ChainQuantity q = chain_quantity(name);
+    if (q == ChainQuantity::None){
+        return nullptr;
+    }
+    return [q](const MarkovChain& mc){
+        const ChainType& c = static_cast<const ChainType&>(mc);
+        return chain_quantity_value(q, c.energy(), c.magnetization());
+    };
+}
 
 
 struct SpinState : public State{
@@ -35,6 +97,16 @@ struct SpinState : public State{
         return std::make_unique<SpinState>(*this);
     }
 
+    std::vector<size_t> snapshot_shape() const override{ return {shape[0], shape[1]};}
+
+    void snapshot(void* out) const override;
+
+    void load_snapshot(const void* in) override;
+
+    void save(BinaryWriter& out) const override; //one bit per spin
+
+    void load(BinaryReader& in) override; //takes the shape of the saved state
+
     const int& operator()(const long int& i) const;
 
     int& operator()(const long int& i);
@@ -47,10 +119,21 @@ struct SpinState : public State{
 
     double M() const;
 
-    double energy() const;
+    double energy() const; //with unit couplings and no field
+
+    double energy(const double& Jx, const double& Jy, const double& h) const; //-Jx*sum(x bonds) - Jy*sum(y bonds) - h*M
+
+    double structure_factor(const size_t& nx, const size_t& ny) const; //|sum_r s_r exp(iq*r)|^2 / N, with q = 2pi*(nx/Lx, ny/Ly)
 
     std::vector<size_t> neighbors(const size_t& site);
 
+    inline std::array<int, 2> local_field(const size_t& k) const{
+        //sums of the two x neighbors and of the two y neighbors of site k. Flipping it changes the x and y bond sums by 2*s*hx and 2*s*hy
+        const size_t Lx = shape[0], Ly = shape[1], i = k % Lx, j = k / Lx;
+        const int* s = spins.data();
+        return {s[j*Lx + (i+Lx-1)%Lx] + s[j*Lx + (i+1)%Lx], s[((j+Ly-1)%Ly)*Lx + i] + s[((j+1)%Ly)*Lx + i]};
+    }
+
     size_t index(long int i, long int j) const;
 
 };
@@ -58,6 +141,14 @@ struct SpinState : public State{
 
 class IsingModel2DMarkovChain : public MarkovChain{
 
+    /*
+    Ising model E = -Jx sum s_i s_(i+x) - Jy sum s_i s_(i+y) - h sum s_i on a periodic Lx x Ly lattice (Jx = Jy = 1 and h = 0 by default).
+    The energy change of a flip only depends on the spin and the sums of its horizontal and vertical neighbors,
+    so the Metropolis updates look up their acceptance in a table of 18 entries that is rebuilt whenever T, the couplings or the field change.
+    The cluster updates (wolff, sw) require h = 0 and non negative couplings.
+    With a zero coupling the lattice falls apart into independent chains, on which the fixed order of the checkerboard updates
+    is not ergodic (zero energy flips are always accepted), so ssf or sw should be used instead.
+    */
 
 public:
 
@@ -65,29 +156,115 @@ public:
         return _T;
     }
 
-    IsingModel2DMarkovChain(const double& T, const size_t& Lx, const size_t& Ly) : MarkovChain(SpinState(random_spins(Lx, Ly), Lx, Ly)), _T(T), _spin_roulette(0, Lx*Ly-1){}
+    inline void set_temp(const double& T){
+        _T = T;
+        _set_acceptance();
+    }
+
+    inline const double& Jx() const{ return _Jx;}
 
-    inline MarkovChain* clone() const override{ return new IsingModel2DMarkovChain(*this);}
+    inline const double& Jy() const{ return _Jy;}
 
-    inline std::unique_ptr<MarkovChain> safe_clone() const override{ return std::make_unique<IsingModel2DMarkovChain>(*this);}
+    inline const double& h() const{ return _h;}
 
-    propagator method(const std::string& name) const override;
+    inline void set_couplings(const double& Jx, const double& Jy){
+        _Jx = Jx;
+        _Jy = Jy;
+        _set_acceptance();
+    }
+
+    inline void set_field(const double& h){
+        _h = h;
+        _set_acceptance();
+    }
+
+    IsingModel2DMarkovChain(const double& T, const size_t& Lx, const size_t& Ly, const double& Jx=1, const double& Jy=1, const double& h=0) : MarkovChain(SpinState(std::vector<int>(Lx*Ly, 1), Lx, Ly)), _T(T), _Jx(Jx), _Jy(Jy), _h(h){
+        static_cast<SpinState&>(*this->_state).spins = random_spins(Lx, Ly, this->_gen);
+        _set_acceptance();
+        _allocate();
+        _recompute();
+        set_threads(1);
+    }
+
+    //the strip generators of a copy are re-derived from its own (new) stream
+    inline MarkovChain* clone() const override{ return this->safe_clone().release();}
+
+    inline std::unique_ptr<MarkovChain> safe_clone() const override{
+        auto res = std::make_unique<IsingModel2DMarkovChain>(*this);
+        res->set_threads(this->threads());
+        return res;
+    }
+
+    UpdateMethod method(const std::string& name) const override;
 
     void ssf_update();
 
     void wolff_update();
 
+    void checkerboard_update(); //one full sweep: all "red" sites and then all "black" sites (i+j even/odd). Requires even Lx, Ly
+
+    void parallel_checkerboard_update(); //same as checkerboard_update, but the lattice is split in horizontal strips that are updated by different threads
+
+    void sw_update(); //Swendsen-Wang: all clusters are built at once with a parallel union-find, and each one is flipped with probability 1/2
+
+    void set_threads(int threads); //number of strips (and threads) used by parallel_checkerboard_update and sw_update. If threads <= 0, all available threads are used
+
+    inline size_t threads() const{ return _strip_gen.size();}
+
+    void exchange_configuration(IsingModel2DMarkovChain& other); //swaps the spins (in place), running sums, random streams and strips with a chain of the same lattice size. T, couplings, field and counters stay
+
+    void seed(const uint64_t& seed, const uint64_t& stream) override;
+
+    void save(BinaryWriter& out) const override;
+
+    void load(BinaryReader& in) override; //the lattice size is taken from the checkpoint
+
+    size_t memory() const override;
+
     const SpinState& ising_state() const{
         return static_cast<const SpinState&>(this->state());
     }
 
+    inline double energy() const{ return _Jx*_Ex + _Jy*_Ey - _h*_M;} //energy of the current state, kept up to date by all update methods
+
+    inline double magnetization() const{ return _M;}
+
 private:
 
     double _T;
+    double _Jx, _Jy, _h;
+    long int _Ex; //running bond sums -sum s_i s_(i+x), -sum s_i s_(i+y) and magnetization. Every update adds the change of the spins it flips
+    long int _Ey;
+    long int _M;
     mutable std::uniform_int_distribution<size_t> _spin_roulette;
+    std::array<uint64_t, 18> _threshold; //Metropolis acceptance of each _lut entry, as a threshold for a raw 32-bit random number (see acceptance_threshold)
+    std::array<double, 18> _acceptance; //the same probabilities, for the kernels that draw uniform doubles in bulk
+    double _bond_prob_x; //probability 1-exp(-2J/T) of activating a bond between parallel spins in cluster updates, in each direction
+    double _bond_prob_y;
+    std::vector<double> _rand_buffer; //uniform numbers for one row of a sublattice
+    std::vector<Philox> _strip_gen; //substreams of the chain's generator, one for each strip of the parallel updates
+    std::vector<std::vector<double>> _strip_buffer;
+    std::vector<size_t> _cluster_stack; //preallocated work buffers of the cluster updates
+    std::vector<size_t> _parent;
+    std::vector<uint8_t> _flip_cluster;
+    std::vector<uint8_t> _in_cluster; //zero outside of wolff_update
 
     inline size_t _choose_site() const{return _spin_roulette(this->_gen);}
 
+    static inline size_t _lut(const int& s, const int& hx, const int& hy){
+        //table entry of a spin s whose horizontal and vertical neighbors sum to hx and hy (in {-2, 0, 2}).
+        //Flipping it changes the energy by 2*s*(Jx*hx + Jy*hy + h)
+        return (9*s + 3*hx + hy + 17) >> 1;
+    }
+
+    void _set_acceptance();
+
+    void _allocate(); //sizes the work buffers after the lattice
+
+    void _recompute(); //bond sums and magnetization from scratch
+
+    void _count_clusters(); //adds the clusters of the last sw_update to the counters
+
 };
 
 
@@ -97,7 +274,7 @@ class IsingModel2D : public MonteCarlo{
 
 public:
 
-    IsingModel2D(const double& T, const size_t& Lx, const size_t& Ly): MonteCarlo(IsingModel2DMarkovChain(T, Lx, Ly)){}
+    IsingModel2D(const double& T, const size_t& Lx, const size_t& Ly, const double& Jx=1, const double& Jy=1, const double& h=0): MonteCarlo(IsingModel2DMarkovChain(T, Lx, Ly, Jx, Jy, h)){}
 
     void ssf_update(const size_t& steps, const size_t& sweeps = 0){
         this->update("ssf", steps, sweeps);
@@ -115,18 +292,72 @@ public:
         this->thermalize("wolff", sweeps);
     }
 
+    void sw_update(const size_t& steps, const size_t& sweeps = 0){
+        this->update("sw", steps, sweeps);
+    }
+
+    void sw_thermalize(const size_t& sweeps){
+        this->thermalize("sw", sweeps);
+    }
+
+    void checkerboard_update(const size_t& steps, const size_t& sweeps = 0){
+        this->update("checkerboard", steps, sweeps);
+    }
+
+    void checkerboard_thermalize(const size_t& sweeps){
+        this->thermalize("checkerboard", sweeps);
+    }
+
+    void parallel_checkerboard_update(const size_t& steps, const size_t& sweeps = 0){
+        this->update("parallel_checkerboard", steps, sweeps);
+    }
+
+    void parallel_checkerboard_thermalize(const size_t& sweeps){
+        this->thermalize("parallel_checkerboard", sweeps);
+    }
+
+    inline void set_threads(const int& threads){
+        this->_chain().set_threads(threads);
+    }
+
    inline Sample energy_sample() const{
-        return this->sample([](const State& s){return static_cast<const SpinState&>(s).energy();});
+        return this->sample("energy");
+   }
+
+   inline Sample structure_factor_sample(const size_t& nx, const size_t& ny) const{
+        return this->sample([nx, ny](const State& s){return static_cast<const SpinState&>(s).structure_factor(nx, ny);}, -1);
    }
 
    inline double T() const{
         return this->chain().Temp();
    }
 
+   inline void set_T(const double& T){
+        this->_chain().set_temp(T);
+   }
+
+   inline void set_couplings(const double& Jx, const double& Jy){
+        this->_chain().set_couplings(Jx, Jy);
+   }
+
+   inline void set_field(const double& h){
+        this->_chain().set_field(h);
+   }
+
+   void exchange_chain(IsingModel2D& other); //swaps the current configurations (and random streams) of two simulations of the same lattice size. Each simulation keeps its own temperature, couplings, field and statistics
+
    inline const IsingModel2DMarkovChain& chain() const {
     return static_cast<IsingModel2DMarkovChain&>(*this->_mc);
 }
 
+protected:
+
+    Observable _builtin_observable(const std::string& name) const override;
+
+    ChainObservable _builtin_chain_observable(const std::string& name) const override;
+
+    inline bool _chain_quantities() const override{ return true;}
+
 private:
 
     inline IsingModel2DMarkovChain& _chain(){
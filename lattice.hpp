@@ -0,0 +1,549 @@
+#ifndef LATTICE_HPP
+#define LATTICE_HPP
+
+#include "ising.hpp"
+
+/*
+Lattice models specialized at compile time.
+
+A lattice type fixes the dimension, the coordination number and the boundary condition, and builds a neighbor table once.
+A spin model fixes the spin type and the bond energy.
+The update kernels are instantiated for every combination, so the neighbor loops have a constant trip count and are unrolled,
+and open boundaries cost nothing: missing neighbors point to an extra "ghost" site whose spin has zero bond energy with every spin.
+
+The neighbor table lists the coordination/2 "forward" neighbors of each site first, so that iterating over them visits every bond once.
+*/
+
+enum class Boundary{Periodic, Open};
+
+template<size_t D, Boundary B>
+struct HypercubicLattice;
+
+template<Boundary B>
+struct TriangularLattice;
+
+struct Ising;
+
+template<int Q>
+struct Potts;
+
+struct XY;
+
+template<class Lattice, class Model>
+struct LatticeState;
+
+template<class Lattice, class Model>
+class LatticeMarkovChain;
+
+template<class Lattice, class Model>
+class LatticeModel;
+
+
+template<size_t D, class Offsets>
+std::vector<uint32_t> build_neighbor_table(const std::array<size_t, D>& shape, const Offsets& offsets, const bool& periodic){
+    //offsets[n] is the displacement of the n-th neighbor. Neighbors that fall outside an open lattice are the ghost site (index = number of sites)
+    size_t N = 1;
+    for (const size_t& L : shape){
+        N *= L;
+    }
+    if (N >= std::numeric_limits<uint32_t>::max()){
+        throw std::runtime_error("The lattice is too large");
+    }
+    const size_t z = offsets.size();
+    std::vector<uint32_t> res(N*z);
+    std::array<size_t, D> x = {};
+    for (size_t k=0; k<N; k++){
+        for (size_t n=0; n<z; n++){
+            size_t nb = 0, stride = 1;
+            bool outside = false;
+            for (size_t d=0; d<D; d++){
+                long int y = long(x[d]) + offsets[n][d];
+                outside |= (y < 0 || y >= long(shape[d]));
+                y = (y + long(shape[d])) % long(shape[d]);
+                nb += y*stride;
+                stride *= shape[d];
+            }
+            res[k*z+n] = (outside && !periodic) ? N : nb;
+        }
+        //next site, with x[0] running fastest (same layout as SpinState)
+        for (size_t d=0; d<D && ++x[d] == shape[d]; d++){
+            x[d] = 0;
+        }
+    }
+    return res;
+}
+
+
+template<size_t D, Boundary B = Boundary::Periodic>
+struct HypercubicLattice{
+
+    //chain (D=1), square (D=2) or simple cubic (D=3) lattice
+
+    static constexpr size_t dim = D;
+    static constexpr size_t coordination = 2*D;
+
+    static std::string name(){ return "HypercubicLattice<" + std::to_string(D) + (B == Boundary::Periodic ? ",periodic>" : ",open>");}
+
+    static std::vector<uint32_t> neighbor_table(const std::array<size_t, D>& shape){
+        std::array<std::array<long int, D>, 2*D> offsets = {};
+        for (size_t d=0; d<D; d++){
+            offsets[d][d] = 1;
+            offsets[D+d][d] = -1;
+        }
+        return build_neighbor_table<D>(shape, offsets, B == Boundary::Periodic);
+    }
+};
+
+template<Boundary B = Boundary::Periodic>
+using SquareLattice = HypercubicLattice<2, B>;
+
+template<Boundary B = Boundary::Periodic>
+using CubicLattice = HypercubicLattice<3, B>;
+
+
+template<Boundary B>
+struct TriangularLattice{
+
+    //square grid with one extra diagonal: the neighbors of (i, j) are (i+-1, j), (i, j+-1), (i-1, j+1) and (i+1, j-1)
+
+    static constexpr size_t dim = 2;
+    static constexpr size_t coordination = 6;
+
+    static std::string name(){ return B == Boundary::Periodic ? "TriangularLattice<periodic>" : "TriangularLattice<open>";}
+
+    static std::vector<uint32_t> neighbor_table(const std::array<size_t, 2>& shape){
+        const std::array<std::array<long int, 2>, 6> offsets = {{{1, 0}, {0, 1}, {-1, 1}, {-1, 0}, {0, -1}, {1, -1}}};
+        return build_neighbor_table<2>(shape, offsets, B == Boundary::Periodic);
+    }
+};
+
+
+/*
+Spin models. Each one defines
+    spin_type, ghost (spin with zero bond energy), the snapshot format of a spin,
+    bond(a, b): energy of a bond, and magnetization(s): contribution of a spin to the magnetization,
+    random(gen) and propose(s, gen): a uniformly random spin, and a trial spin for a Metropolis move,
+    delta_energy<z>(old, new, spins, neighbors): energy change of replacing old by new,
+    and, if discrete is true, the largest |energy change| for a given coordination, so that acceptance probabilities can be tabulated.
+Spins are written in snapshots as they are, unless the format is 'd', in which case the model converts them with to_snapshot and from_snapshot.
+*/
+
+struct Ising{
+
+    //s = +-1, bond energy -s1*s2
+
+    using spin_type = int8_t;
+    using energy_type = long int;
+    static constexpr bool discrete = true;
+    static constexpr spin_type ghost = 0;
+    static constexpr char format = 'b';
+
+    static std::string name(){ return "Ising";}
+
+    static constexpr long int max_delta(const size_t& z){ return 2*z;}
+
+    static inline long int bond(const spin_type& a, const spin_type& b){ return -a*b;}
+
+    static inline double magnetization(const spin_type& s){ return s;}
+
+    static inline spin_type random(Philox& gen){ return (gen() & 1) ? 1 : -1;}
+
+    static inline spin_type propose(const spin_type& s, Philox&){ return -s;}
+
+    template<size_t z>
+    static inline long int delta_energy(const spin_type& old, const spin_type&, const spin_type* spins, const uint32_t* nb){
+        int h = 0;
+        for (size_t n=0; n<z; n++){
+            h += spins[nb[n]];
+        }
+        return 2*old*h;
+    }
+};
+
+
+template<int Q>
+struct Potts{
+
+    //s in {0, ..., Q-1}, bond energy -delta(s1, s2). The magnetization is the order parameter along state 0, (Q*delta(s, 0)-1)/(Q-1) per site
+
+    static_assert(Q >= 2 && Q < 255);
+
+    using spin_type = uint8_t;
+    using energy_type = long int;
+    static constexpr bool discrete = true;
+    static constexpr spin_type ghost = Q;
+    static constexpr char format = 'B';
+
+    static std::string name(){ return "Potts<" + std::to_string(Q) + ">";}
+
+    static constexpr long int max_delta(const size_t& z){ return z;}
+
+    static inline long int bond(const spin_type& a, const spin_type& b){ return -(a == b);}
+
+    static inline double magnetization(const spin_type& s){ return (Q*(s == 0) - 1)/(Q - 1.);}
+
+    static inline spin_type random(Philox& gen){ return spin_type((uint64_t(gen())*Q) >> 32);}
+
+    static inline spin_type propose(const spin_type& s, Philox& gen){
+        //uniformly one of the other Q-1 states
+        return spin_type((s + 1 + ((uint64_t(gen())*(Q-1)) >> 32)) % Q);
+    }
+
+    template<size_t z>
+    static inline long int delta_energy(const spin_type& old, const spin_type& s, const spin_type* spins, const uint32_t* nb){
+        long int de = 0;
+        for (size_t n=0; n<z; n++){
+            de += (spins[nb[n]] == old) - (spins[nb[n]] == s);
+        }
+        return de;
+    }
+};
+
+
+struct XYSpin{
+    double x, y;
+};
+
+struct XY{
+
+    //planar unit vectors, bond energy -s1.s2. The magnetization is the x component. Snapshots hold the angles
+
+    using spin_type = XYSpin;
+    using energy_type = double;
+    static constexpr bool discrete = false;
+    static constexpr spin_type ghost = {0, 0};
+    static constexpr char format = 'd';
+
+    static std::string name(){ return "XY";}
+
+    static inline double bond(const spin_type& a, const spin_type& b){ return -(a.x*b.x + a.y*b.y);}
+
+    static inline double magnetization(const spin_type& s){ return s.x;}
+
+    static inline spin_type random(Philox& gen){
+        const double theta = 2*M_PI*gen.uniform();
+        return {std::cos(theta), std::sin(theta)};
+    }
+
+    static inline spin_type propose(const spin_type&, Philox& gen){ return random(gen);}
+
+    template<size_t z>
+    static inline double delta_energy(const spin_type& old, const spin_type& s, const spin_type* spins, const uint32_t* nb){
+        double hx = 0, hy = 0;
+        for (size_t n=0; n<z; n++){
+            hx += spins[nb[n]].x;
+            hy += spins[nb[n]].y;
+        }
+        return -((s.x-old.x)*hx + (s.y-old.y)*hy);
+    }
+
+    static inline double to_snapshot(const spin_type& s){ return std::atan2(s.y, s.x);}
+
+    static inline spin_type from_snapshot(const double& theta){ return {std::cos(theta), std::sin(theta)};}
+};
+
+
+template<class Lattice, class Model>
+struct LatticeState : public State{
+
+    /*
+    Spins of a lattice model. spins has one extra entry at the end, the ghost site.
+    The neighbor table is shared between copies of the state.
+    */
+
+    using spin_type = typename Model::spin_type;
+    using lattice_type = Lattice;
+    static constexpr size_t z = Lattice::coordination;
+
+    std::array<size_t, Lattice::dim> shape;
+    std::vector<spin_type> spins;
+    std::shared_ptr<const std::vector<uint32_t>> neighbors; //neighbors of site k: (*neighbors)[k*z], ..., (*neighbors)[k*z+z-1]
+
+    LatticeState(const std::array<size_t, Lattice::dim>& shape) : shape(shape), neighbors(std::make_shared<const std::vector<uint32_t>>(Lattice::neighbor_table(shape))){
+        spins.assign(neighbors->size()/z + 1, Model::ghost);
+    }
+
+    State* clone() const override{
+        return new LatticeState(*this);
+    }
+
+    std::unique_ptr<State> safe_clone() const override{
+        return std::make_unique<LatticeState>(*this);
+    }
+
+    std::vector<size_t> snapshot_shape() const override{ return std::vector<size_t>(shape.begin(), shape.end());} //same convention as SpinState
+
+    char snapshot_format() const override{ return Model::format;}
+
+    size_t snapshot_itemsize() const override{ return (Model::format == 'd') ? sizeof(double) : 1;}
+
+    void snapshot(void* out) const override{
+        for (size_t k=0; k<this->sites(); k++){
+            if constexpr (Model::format == 'd'){
+                static_cast<double*>(out)[k] = Model::to_snapshot(spins[k]);
+            }
+            else{
+                static_cast<spin_type*>(out)[k] = spins[k];
+            }
+        }
+    }
+
+    void load_snapshot(const void* in) override{
+        for (size_t k=0; k<this->sites(); k++){
+            if constexpr (Model::format == 'd'){
+                spins[k] = Model::from_snapshot(static_cast<const double*>(in)[k]);
+            }
+            else{
+                spins[k] = static_cast<const spin_type*>(in)[k];
+            }
+        }
+    }
+
+    inline size_t sites() const{ return spins.size()-1;}
+
+    inline const uint32_t* neighbors_of(const size_t& k) const{ return neighbors->data() + k*z;}
+
+    double energy() const{
+        typename Model::energy_type res = 0;
+        for (size_t k=0; k<this->sites(); k++){
+            const uint32_t* nb = this->neighbors_of(k);
+            for (size_t n=0; n<z/2; n++){
+                res += Model::bond(spins[k], spins[nb[n]]);
+            }
+        }
+        return res;
+    }
+
+    double M() const{
+        double res = 0;
+        for (size_t k=0; k<this->sites(); k++){
+            res += Model::magnetization(spins[k]);
+        }
+        return res;
+    }
+};
+
+
+template<class Lattice, class Model>
+class LatticeMarkovChain : public MarkovChain{
+
+    /*
+    Metropolis chain of any lattice model, with the running energy and magnetization kept up to date (see IsingModel2DMarkovChain).
+    Methods:
+        "ssf": a single update of a random site
+        "sweep": one update of every site, in memory order
+    For discrete models the acceptance probabilities are tabulated for every possible energy change, as thresholds for raw 32-bit random numbers.
+    */
+
+public:
+
+    using StateType = LatticeState<Lattice, Model>;
+    using spin_type = typename Model::spin_type;
+    static constexpr size_t z = Lattice::coordination;
+
+    LatticeMarkovChain(const double& T, const std::array<size_t, Lattice::dim>& shape) : MarkovChain(StateType(shape)), _T(T){
+        StateType& S = this->_lattice_state();
+        for (size_t k=0; k<S.sites(); k++){
+            S.spins[k] = Model::random(this->_gen);
+        }
+        _set_acceptance();
+        _recompute();
+    }
+
+    inline MarkovChain* clone() const override{ return new LatticeMarkovChain(*this);}
+
+    inline std::unique_ptr<MarkovChain> safe_clone() const override{ return std::make_unique<LatticeMarkovChain>(*this);}
+
+    UpdateMethod method(const std::string& name) const override{
+        if (name == "ssf"){
+            return static_method<LatticeMarkovChain, &LatticeMarkovChain::ssf_update>();
+        }
+        else if (name == "sweep"){
+            return static_method<LatticeMarkovChain, &LatticeMarkovChain::sweep_update>();
+        }
+        throw std::runtime_error("Unknown update method \"" + name + "\"");
+    }
+
+    inline const double& Temp() const{ return _T;}
+
+    inline void set_temp(const double& T){
+        _T = T;
+        _set_acceptance();
+    }
+
+    inline const StateType& lattice_state() const{ return static_cast<const StateType&>(this->state());}
+
+    size_t memory() const override{
+        //the neighbor table is shared by all copies of the state, but counted in full
+        const StateType& S = this->lattice_state();
+        return S.spins.capacity()*sizeof(spin_type) + S.neighbors->capacity()*sizeof(uint32_t) + _threshold.capacity()*sizeof(uint64_t);
+    }
+
+    inline double energy() const{ return _E;}
+
+    inline double magnetization() const{ return _M;}
+
+    void ssf_update(){
+        StateType& S = this->_lattice_state();
+        const size_t k = (uint64_t(this->_gen())*S.sites()) >> 32;
+        const bool accept = _update_site(S, k);
+        if (this->counting()){
+            this->_counters.proposals++;
+            this->_counters.accepted += accept;
+        }
+    }
+
+    void sweep_update(){
+        StateType& S = this->_lattice_state();
+        size_t accepted = 0;
+        for (size_t k=0; k<S.sites(); k++){
+            accepted += _update_site(S, k);
+        }
+        if (this->counting()){
+            this->_counters.proposals += S.sites();
+            this->_counters.accepted += accepted;
+        }
+    }
+
+    void save(BinaryWriter& out) const override{
+        out.write_string("LatticeMarkovChain<" + Lattice::name() + "," + Model::name() + ">");
+        MarkovChain::save(out);
+        out.write(_T);
+    }
+
+    void load(BinaryReader& in) override{
+        in.expect("LatticeMarkovChain<" + Lattice::name() + "," + Model::name() + ">");
+        MarkovChain::load(in);
+        _T = in.read<double>();
+        _set_acceptance();
+        _recompute();
+    }
+
+private:
+
+    double _T;
+    typename Model::energy_type _E;
+    double _M;
+    std::vector<uint64_t> _threshold; //acceptance_threshold(min(1, exp(-dE/T))) for dE = -max_delta, ..., max_delta (discrete models only)
+
+    inline StateType& _lattice_state(){ return static_cast<StateType&>(*this->_state);}
+
+    inline bool _update_site(StateType& S, const size_t& k){
+        //returns true if the move was accepted
+        const spin_type old = S.spins[k];
+        const spin_type s = Model::propose(old, this->_gen);
+        const auto de = Model::template delta_energy<z>(old, s, S.spins.data(), S.neighbors_of(k));
+        bool accept;
+        if constexpr (Model::discrete){
+            accept = this->_gen() < _threshold[de + Model::max_delta(z)];
+        }
+        else{
+            accept = (de <= 0) || (this->_gen.uniform() < std::exp(-de/_T));
+        }
+        if (accept){
+            S.spins[k] = s;
+            _E += de;
+            _M += Model::magnetization(s) - Model::magnetization(old);
+        }
+        return accept;
+    }
+
+    void _set_acceptance(){
+        if constexpr (Model::discrete){
+            const long int m = Model::max_delta(z);
+            _threshold.resize(2*m+1);
+            for (long int de=-m; de<=m; de++){
+                _threshold[de+m] = acceptance_threshold(std::min(1., std::exp(-de/_T)));
+            }
+        }
+    }
+
+    void _recompute(){
+        _E = this->lattice_state().energy();
+        _M = this->lattice_state().M();
+    }
+};
+
+
+template<class Lattice, class Model>
+class LatticeModel : public MonteCarlo{
+
+    //Monte Carlo simulation of a lattice model. Built-in observables: "energy", "M", "|M|", "M^2"
+
+public:
+
+    using ChainType = LatticeMarkovChain<Lattice, Model>;
+    using StateType = LatticeState<Lattice, Model>;
+
+    LatticeModel(const double& T, const std::array<size_t, Lattice::dim>& shape) : MonteCarlo(ChainType(T, shape)){}
+
+    void ssf_update(const size_t& steps, const size_t& sweeps = 0){
+        this->update("ssf", steps, sweeps);
+    }
+
+    void ssf_thermalize(const size_t& sweeps){
+        this->thermalize("ssf", sweeps);
+    }
+
+    void sweep_update(const size_t& steps, const size_t& sweeps = 0){
+        this->update("sweep", steps, sweeps);
+    }
+
+    void sweep_thermalize(const size_t& sweeps){
+        this->thermalize("sweep", sweeps);
+    }
+
+    inline Sample energy_sample() const{
+        return this->sample("energy");
+    }
+
+    inline double T() const{
+        return this->chain().Temp();
+    }
+
+    inline void set_T(const double& T){
+        static_cast<ChainType&>(*this->_mc).set_temp(T);
+    }
+
+    inline const ChainType& chain() const{
+        return static_cast<const ChainType&>(*this->_mc);
+    }
+
+protected:
+
+    Observable _builtin_observable(const std::string& name) const override{
+        if (name == "energy"){
+            return [](const State& s){return static_cast<const StateType&>(s).energy();};
+        }
+        else if (name == "M"){
+            return [](const State& s){return static_cast<const StateType&>(s).M();};
+        }
+        else if (name == "|M|"){
+            return [](const State& s){return std::abs(static_cast<const StateType&>(s).M());};
+        }
+        else if (name == "M^2"){
+            return [](const State& s){return pow(static_cast<const StateType&>(s).M(), 2);};
+        }
+        return MonteCarlo::_builtin_observable(name);
+    }
+
+    ChainObservable _builtin_chain_observable(const std::string& name) const override{
+        ChainObservable res = chain_observable<ChainType>(name);
+        return res ? res : MonteCarlo::_builtin_chain_observable(name);
+    }
+
+    inline bool _chain_quantities() const override{ return true;}
+};
+
+
+using Ising3D = LatticeModel<CubicLattice<>, Ising>;
+
+using IsingTriangular = LatticeModel<TriangularLattice<Boundary::Periodic>, Ising>;
+
+template<int Q>
+using Potts2D = LatticeModel<SquareLattice<>, Potts<Q>>;
+
+using XY2D = LatticeModel<SquareLattice<>, XY>;
+
+
+#endif
@@ -1,14 +1,51 @@
 #include "mc.hpp"
+#include <chrono>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <filesystem>
+#include <sstream>
 
 
 MarkovChain& MarkovChain::operator=(const MarkovChain& other){
-    delete _state;
-    _state = other._state->clone();
-    _gen = other._gen;
-    _uniform_dist = other._uniform_dist;
+    _state.reset(other._state->clone());
+    _gen = Philox(other._gen.seed(), next_stream());
+    _counters = other._counters;
+    _counting = other._counting;
     return *this;
 }
 
+ChainCounters& ChainCounters::operator+=(const ChainCounters& other){
+    proposals += other.proposals;
+    accepted += other.accepted;
+    clusters += other.clusters;
+    cluster_sites += other.cluster_sites;
+    for (size_t k=0; k<cluster_sizes.size(); k++){
+        cluster_sizes[k] += other.cluster_sizes[k];
+    }
+    update_seconds += other.update_seconds;
+    measure_seconds += other.measure_seconds;
+    store_seconds += other.store_seconds;
+    return *this;
+}
+
+ChainQuantity chain_quantity(const std::string& name){
+    if (name == "energy"){
+        return ChainQuantity::Energy;
+    }
+    else if (name == "M"){
+        return ChainQuantity::M;
+    }
+    else if (name == "|M|"){
+        return ChainQuantity::AbsM;
+    }
+    else if (name == "M^2"){
+        return ChainQuantity::M2;
+    }
+    return ChainQuantity::None;
+}
+
 void MarkovChain::update(propagator method, const size_t& steps){
     for (size_t i=0; i<steps; i++){
         (this->*method)();
@@ -16,61 +53,633 @@ void MarkovChain::update(propagator method, const size_t& steps){
 }
 
 double MarkovChain::draw_uniform(const double& a, const double& b){
-    return this->_uniform_dist(_gen)*(b-a) + a;
+    return _gen.uniform()*(b-a) + a;
+}
+
+void MarkovChain::fill_uniform(double* out, const size_t& n){
+    _gen.fill_uniform(out, n);
+}
+
+size_t MarkovChain::memory() const{
+    return _state->snapshot_bytes();
+}
+
+void MarkovChain::seed(const uint64_t& seed, const uint64_t& stream){
+    _gen.seed(seed, stream);
+}
+
+void MarkovChain::save(BinaryWriter& out) const{
+    save_rng(out, _gen);
+    _state->save(out);
+}
+
+void MarkovChain::load(BinaryReader& in){
+    _gen = load_rng(in);
+    _state->load(in);
+}
+
+void MarkovChain::reuse_state(MarkovChain& previous){
+    if (previous._state->snapshot_shape() != _state->snapshot_shape()){
+        return;
+    }
+    //the checkpoint format of the state is exact, and loading it keeps the storage of a state of the same shape
+    std::stringstream buffer;
+    BinaryWriter out(buffer);
+    _state->save(out);
+    BinaryReader in(buffer);
+    previous._state->load(in);
+    std::swap(_state, previous._state);
+}
+
+void save_rng(BinaryWriter& out, const Philox& gen){
+    out.write(gen.seed());
+    out.write(gen.stream());
+    out.write(gen.substream());
+    out.write(gen.counter());
+    out.write<uint32_t>(gen.index());
+}
+
+Philox load_rng(BinaryReader& in){
+    const uint64_t seed = in.read<uint64_t>();
+    const uint64_t stream = in.read<uint64_t>();
+    const uint32_t substream = in.read<uint32_t>();
+    const uint64_t counter = in.read<uint64_t>();
+    const uint32_t index = in.read<uint32_t>();
+    Philox res(seed, stream, substream);
+    res.set_position(counter, index);
+    return res;
 }
 
 MonteCarlo& MonteCarlo::operator=(const MonteCarlo& other){
     if (&other != this){
-        _clear_states();
         delete this->_mc;
         this->_mc = other._mc->clone();
-        this->_data = copy_states(other._data);
+        this->_data = other._data;
+        this->_obs_names = other._obs_names;
+        this->_obs = other._obs;
+        this->_obs_q = other._obs_q;
+        this->_acc = other._acc;
+        this->_store_states = other._store_states;
+        this->_hist = other._hist;
+        this->_hist_E = other._hist_E;
+        this->_hist_M = other._hist_M;
     }
     return *this;
 }
 
 
-std::vector<const State*> MonteCarlo::data() const{ //array of states used for our statistics
-    std::vector<const State*> res(_data.size());
-    for (size_t i=0; i<_data.size(); i++){
-        res[i] = _data[i];
+std::vector<std::unique_ptr<State>> MonteCarlo::data() const{ //array of states used for our statistics
+    std::vector<std::unique_ptr<State>> res(this->N());
+    for (size_t i=0; i<this->N(); i++){
+        res[i] = this->state(i);
     }
     return res;
 }
 
-Sample MonteCarlo::sample(const Observable A) const{ //each state generates a sample element, so all monte carlo states generate an entire sample to perform statistics.
+std::unique_ptr<State> MonteCarlo::state(const size_t& i) const{
+    std::unique_ptr<State> res = this->_mc->state().safe_clone();
+    _data.load(i, *res);
+    return res;
+}
+
+Sample MonteCarlo::sample(const Observable& A, int threads) const{ //each state generates a sample element, so all monte carlo states generate an entire sample to perform statistics.
     std::vector<double> sample_array(this->N());
-    for (size_t i=0; i<this->N(); i++){
-        sample_array[i] = A(*this->_data[i]);
+    threads = (threads <= 0) ? omp_get_max_threads() : threads;
+    //an exception must not leave the parallel region, so the first one is kept, the remaining states are skipped, and it is rethrown afterwards
+    std::exception_ptr error = nullptr;
+    std::atomic<bool> failed(false);
+    #pragma omp parallel num_threads(threads)
+    {
+        //every thread loads the snapshots into its own state
+        std::unique_ptr<State> state = this->_mc->state().safe_clone();
+        #pragma omp for schedule(static)
+        for (size_t i=0; i<this->N(); i++){
+            if (failed.load(std::memory_order_relaxed)){
+                continue;
+            }
+            try{
+                _data.load(i, *state);
+                sample_array[i] = A(*state);
+            }
+            catch (...){
+                #pragma omp critical
+                {
+                    if (error == nullptr){
+                        error = std::current_exception();
+                    }
+                }
+                failed = true;
+            }
+        }
+    }
+    if (error != nullptr){
+        std::rethrow_exception(error);
     }
     return sample_array;
 }
 
+Sample MonteCarlo::sample(const std::string& name, int threads) const{
+    return this->sample(this->_builtin_observable(name), threads);
+}
+
+Sample MonteCarlo::batch_sample(const BatchObservable& A) const{
+    std::vector<double> res = A(_data);
+    if (res.size() != this->N()){
+        throw std::runtime_error("A batch observable needs to return one value per stored state");
+    }
+    return res;
+}
+
 void MonteCarlo::update(const std::string& method, const size_t& steps, const size_t& sweeps){
-    propagator pr = this->_mc->method(method);
+    const UpdateMethod m = this->_mc->method(method);
+    if (this->_mc->counting()){
+        this->_timed_update(m, steps, sweeps);
+        return;
+    }
+    if (_obs.empty() && !_store_states && !_hist){
+        //nothing to record between steps
+        m.run(*this->_mc, steps*(sweeps+1));
+        return;
+    }
+    if (_store_states){
+        //one allocation for the whole run, instead of repeated doublings (and copies) of the trajectory
+        this->_data.prepare(this->_mc->state(), steps);
+    }
+    const bool quantities = std::find(_obs_q.begin(), _obs_q.end(), ChainQuantity::None) == _obs_q.end() && (!_hist || this->_chain_quantities());
+    if (m.measured != nullptr && quantities){
+        //every observable is a chain quantity, so the whole step/measure loop runs in the static kernel
+        m.measured(*this->_mc, steps, sweeps, _obs_q.data(), _acc.data(), _acc.size(), _hist ? &*_hist : nullptr, _store_states ? &_data : nullptr);
+        return;
+    }
     for (size_t i=0; i<steps; i++){
-        this->_mc->update(pr, sweeps+1);
-        this->_data.push_back(this->_mc->state().clone());
+        m.run(*this->_mc, sweeps+1);
+        this->_measure();
+        if (_store_states){
+            this->_data.append(this->_mc->state());
+        }
+    }
+}
+
+void MonteCarlo::_timed_update(const UpdateMethod& m, const size_t& steps, const size_t& sweeps){
+    //same as update(), with every phase timed separately
+    using clock = std::chrono::steady_clock;
+    ChainCounters& counters = this->_mc->counters();
+    if (_store_states){
+        const auto t0 = clock::now();
+        this->_data.prepare(this->_mc->state(), steps);
+        counters.store_seconds += std::chrono::duration<double>(clock::now() - t0).count();
+    }
+    for (size_t i=0; i<steps; i++){
+        const auto t0 = clock::now();
+        m.run(*this->_mc, sweeps+1);
+        const auto t1 = clock::now();
+        this->_measure();
+        const auto t2 = clock::now();
+        if (_store_states){
+            this->_data.append(this->_mc->state());
+        }
+        const auto t3 = clock::now();
+        counters.update_seconds += std::chrono::duration<double>(t1 - t0).count();
+        counters.measure_seconds += std::chrono::duration<double>(t2 - t1).count();
+        counters.store_seconds += std::chrono::duration<double>(t3 - t2).count();
+    }
+}
+
+static double tau_of(const BinningAccumulator& acc){
+    //a constant observable (zero variance) has no autocorrelation
+    const double tau = (acc.max_level() > 1) ? acc.tau_estimate() : 0;
+    return std::isfinite(tau) ? std::max(tau, 0.) : 0;
+}
+
+static bool target_reached(const BinningAccumulator& acc, const double& error){
+    //at least 4 reliable levels, so that the binned error can see autocorrelations of a few measurements
+    return acc.max_level() >= 4 && !(acc.binned_error() > error);
+}
+
+AdaptiveSchedule MonteCarlo::update_adaptive(const std::string& method, const std::vector<ErrorTarget>& targets, const size_t& max_steps, const size_t& calibration, const size_t& max_sweeps){
+    if (targets.empty()){
+        throw std::runtime_error("update_adaptive needs at least one target observable");
+    }
+    std::vector<size_t> index;
+    for (const ErrorTarget& t : targets){
+        if (!(t.error > 0)){
+            throw std::runtime_error("The target error of \"" + t.observable + "\" needs to be positive");
+        }
+        size_t i = std::find(_obs_names.begin(), _obs_names.end(), t.observable) - _obs_names.begin();
+        if (i == _obs_names.size()){
+            this->add_observable(t.observable);
+        }
+        index.push_back(i);
+    }
+    const UpdateMethod m = this->_mc->method(method);
+    AdaptiveSchedule res;
+    res.tau.resize(targets.size());
+    res.error.resize(targets.size());
+
+    //calibration, with its own statistics. An estimate of tau that is not converged is only a lower bound, so the interval is lengthened and the estimate repeated
+    size_t interval = 1;
+    for (size_t round=0; round<8 && calibration > 0; round++){
+        std::vector<BinningAccumulator> acc(targets.size());
+        for (size_t i=0; i<calibration; i++){
+            m.run(*this->_mc, interval);
+            for (size_t k=0; k<targets.size(); k++){
+                acc[k].add(_obs[index[k]](*this->_mc));
+            }
+        }
+        res.calibration_updates += calibration*interval;
+        double tau = 0;
+        bool reliable = true;
+        for (size_t k=0; k<targets.size(); k++){
+            const double tau_k = tau_of(acc[k]);
+            res.tau[k] = tau_k*interval;
+            tau = std::max(tau, res.tau[k]);
+            reliable = reliable && (tau_k < 1 || acc[k].converged());
+        }
+        const size_t next = std::clamp<size_t>(std::llround(tau), 1, max_sweeps+1);
+        if (reliable || interval == max_sweeps+1){
+            interval = next;
+            break;
+        }
+        interval = std::min(std::max(next, 4*interval), max_sweeps+1);
+    }
+    res.sweeps = interval-1;
+
+    //production, in rounds of 1/8 of the steps so far, so that the targets are overshot by at most about 12%
+    while (res.steps < max_steps){
+        const size_t n = std::min(max_steps - res.steps, std::max<size_t>(64, res.steps/8));
+        this->update(method, n, res.sweeps);
+        res.steps += n;
+        res.reached = true;
+        for (size_t k=0; k<targets.size(); k++){
+            res.reached = res.reached && target_reached(_acc[index[k]], targets[k].error);
+        }
+        if (res.reached){
+            break;
+        }
+    }
+    for (size_t k=0; k<targets.size(); k++){
+        const BinningAccumulator& acc = _acc[index[k]];
+        if (acc.max_level() > 1){
+            res.tau[k] = tau_of(acc)*interval;
+            res.error[k] = acc.binned_error();
+        }
+        else{
+            res.error[k] = std::numeric_limits<double>::infinity();
+        }
     }
+    return res;
+}
+
+void MonteCarlo::add_observable(const std::string& name, const Observable& A){
+    this->add_observable(name, [A](const MarkovChain& mc){return A(mc.state());});
+}
+
+void MonteCarlo::add_observable(const std::string& name, const ChainObservable& A){
+    this->_add_observable(name, A, ChainQuantity::None);
 }
 
-void MonteCarlo::_clear_states(){
-    for (size_t i = 0; i < _data.size(); i++){
-        delete _data[i];
+void MonteCarlo::add_observable(const std::string& name){
+    this->_add_observable(name, this->_builtin_chain_observable(name), this->_chain_quantities() ? chain_quantity(name) : ChainQuantity::None);
+}
+
+void MonteCarlo::_add_observable(const std::string& name, const ChainObservable& A, const ChainQuantity& q){
+    for (size_t i=0; i<_obs_names.size(); i++){
+        if (_obs_names[i] == name){
+            throw std::runtime_error("Observable \"" + name + "\" has already been registered");
+        }
     }
-    _data.clear();
+    _obs_names.push_back(name);
+    _obs.push_back(A);
+    _obs_q.push_back(q);
+    _acc.push_back(BinningAccumulator());
+}
+
+const BinningAccumulator& MonteCarlo::observable(const std::string& name) const{
+    for (size_t i=0; i<_obs_names.size(); i++){
+        if (_obs_names[i] == name){
+            return _acc[i];
+        }
+    }
+    throw std::runtime_error("Observable \"" + name + "\" has not been registered");
+}
+
+void MonteCarlo::reset_observables(){
+    for (BinningAccumulator& acc : _acc){
+        acc.reset();
+    }
+}
+
+void MonteCarlo::save(const std::string& path, const bool& trajectory) const{
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+        if (!file){
+            throw std::runtime_error("Could not open \"" + tmp + "\" for writing");
+        }
+        this->save(file, trajectory);
+        file.close();
+        if (!file){
+            throw std::runtime_error("Failed to write checkpoint \"" + tmp + "\"");
+        }
+    }
+    std::filesystem::rename(tmp, path);
+}
+
+void MonteCarlo::load(const std::string& path){
+    std::ifstream file(path, std::ios::binary);
+    if (!file){
+        throw std::runtime_error("Could not open checkpoint \"" + path + "\"");
+    }
+    this->load(file);
+}
+
+void MonteCarlo::save(std::ostream& out, const bool& trajectory) const{
+    BinaryWriter w(out);
+    w.write_bytes("MCPYCKPT", 8);
+    w.write<uint32_t>(CHECKPOINT_VERSION);
+    w.write<uint32_t>(0x01020304); //byte order
+    _mc->save(w);
+    w.write<uint64_t>(_obs_names.size());
+    for (size_t i=0; i<_obs_names.size(); i++){
+        w.write_string(_obs_names[i]);
+        _acc[i].save(w);
+    }
+    w.write<uint8_t>(_hist.has_value());
+    if (_hist){
+        _hist->save(w);
+    }
+    w.write<uint8_t>(_store_states);
+    w.write<uint8_t>(trajectory);
+    if (trajectory){
+        _data.save(w);
+    }
+}
+
+void MonteCarlo::load(std::istream& in){
+    BinaryReader r(in);
+    char magic[8];
+    r.read_bytes(magic, 8);
+    if (std::string(magic, 8) != "MCPYCKPT"){
+        throw std::runtime_error("Not a checkpoint file");
+    }
+    if (r.read<uint32_t>() != CHECKPOINT_VERSION || r.read<uint32_t>() != 0x01020304){
+        throw std::runtime_error("The checkpoint was written by an incompatible version or platform");
+    }
+    //everything is read into a copy first, so a failed load leaves the simulation unchanged
+    std::unique_ptr<MarkovChain> mc = _mc->safe_clone();
+    mc->load(r);
+    const size_t n_obs = r.read<uint64_t>();
+    std::vector<std::string> names(n_obs);
+    std::vector<BinningAccumulator> acc(n_obs);
+    for (size_t i=0; i<n_obs; i++){
+        names[i] = r.read_string();
+        acc[i].load(r);
+    }
+    std::optional<JointHistogram> hist;
+    if (r.read<uint8_t>()){
+        hist.emplace();
+        hist->load(r);
+    }
+    const bool store_states = r.read<uint8_t>();
+    Trajectory data;
+    if (r.read<uint8_t>()){
+        //the checkpoint may continue the current trajectory file, so the file is released while loading (and reopened if that fails)
+        const std::string file = _data.file();
+        const size_t n = _data.N();
+        if (!file.empty()){
+            _data = Trajectory();
+        }
+        try{
+            data.load(r);
+        }
+        catch (...){
+            if (!file.empty()){
+                _data.open_file(file, n);
+            }
+            throw;
+        }
+    }
+
+    if (hist){
+        _hist_E = this->_builtin_chain_observable("energy");
+        _hist_M = this->_builtin_chain_observable("M");
+    }
+
+    std::vector<std::pair<std::string, ChainObservable>> missing;
+    for (size_t i=0; i<n_obs; i++){
+        if (std::find(_obs_names.begin(), _obs_names.end(), names[i]) == _obs_names.end()){
+            missing.push_back({names[i], this->_builtin_chain_observable(names[i])});
+        }
+    }
+
+    for (const auto& [name, A] : missing){
+        this->_add_observable(name, A, this->_chain_quantities() ? chain_quantity(name) : ChainQuantity::None);
+    }
+    for (size_t i=0; i<_obs_names.size(); i++){
+        const size_t k = std::find(names.begin(), names.end(), _obs_names[i]) - names.begin();
+        _acc[i] = (k < n_obs) ? acc[k] : BinningAccumulator();
+    }
+    _hist = hist;
+    //the loaded configuration goes into the current state object if possible, so that views of the state stay live
+    mc->reuse_state(*_mc);
+    delete _mc;
+    _mc = mc.release();
+    _data = std::move(data);
+    _store_states = store_states;
+}
+
+void MonteCarlo::_measure(){
+    for (size_t i=0; i<_obs.size(); i++){
+        _acc[i].add(_obs[i](*this->_mc));
+    }
+    if (_hist){
+        _hist->add(_hist_E(*this->_mc), _hist_M(*this->_mc));
+    }
+}
+
+void MonteCarlo::record_histogram(const double& T, const double& dE, const double& dM){
+    JointHistogram hist(T, dE, dM);
+    _hist_E = this->_builtin_chain_observable("energy");
+    _hist_M = this->_builtin_chain_observable("M");
+    _hist = hist;
+}
+
+const JointHistogram& MonteCarlo::histogram() const{
+    if (!_hist){
+        throw std::runtime_error("No histogram is being recorded");
+    }
+    return *_hist;
+}
+
+Observable MonteCarlo::_builtin_observable(const std::string& name) const{
+    throw std::runtime_error("No built-in observable named \"" + name + "\"");
+}
+
+ChainObservable MonteCarlo::_builtin_chain_observable(const std::string& name) const{
+    Observable A = this->_builtin_observable(name);
+    return [A](const MarkovChain& mc){return A(mc.state());};
 }
 
 MonteCarlo::~MonteCarlo(){
-    _clear_states();
     delete this->_mc;
 }
 
-void update_all(const std::vector<MonteCarlo*>& obj, const std::string& method, const size_t& steps, const size_t& sweeps, int threads){
+void update_all(const std::vector<MonteCarlo*>& obj, const std::string& method, const size_t& steps, const size_t& sweeps, int threads, const size_t& chunk, const ProgressCallback& progress, std::atomic<bool>* cancel){
 
     threads = (threads <= 0) ? omp_get_max_threads() : threads;
-    #pragma omp parallel for num_threads(threads)
-    for (size_t i=0; i<obj.size(); i++){
-        obj[i]->update(method, steps, sweeps);
+    const size_t n = obj.size();
+    const size_t chunk_steps = (chunk > 0) ? chunk : std::max<size_t>(1, (steps+15)/16);
+    const size_t total = n*steps;
+
+    struct Task{
+        std::atomic<bool> busy{false}; //true while a thread is updating the simulation
+        std::atomic<size_t> remaining{0}; //steps not yet claimed by any thread. Only modified by the thread that holds the simulation
+        std::atomic<double> chunk_time{0}; //duration of the last chunk, used to estimate the remaining work
+    };
+    std::vector<Task> tasks(n);
+    for (size_t i=0; i<n; i++){
+        tasks[i].remaining = steps;
+        //the chunks of a simulation append to a trajectory that already has room for all of them
+        obj[i]->reserve_states(steps);
+    }
+    std::atomic<size_t> unclaimed(total), done(0);
+    std::atomic<bool> stop(false);
+    std::exception_ptr error = nullptr;
+
+    auto cancelled = [&](){
+        return stop.load() || (cancel != nullptr && cancel->load());
+    };
+
+    auto report = [&](){
+        if (progress != nullptr && !progress(done.load(), total)){
+            stop = true;
+        }
+    };
+
+    #pragma omp parallel num_threads(threads)
+    {
+        const bool reporter = (omp_get_thread_num() == 0);
+        try{
+            //the reporting thread keeps running until all steps are done, the rest stop when there is nothing left to claim
+            while ((unclaimed.load() > 0 || (reporter && done.load() < total)) && !cancelled()){
+                //claim the simulation with the largest estimated remaining time. Simulations that have not run yet come first
+                size_t best = n;
+                double best_cost = -1;
+                for (size_t i=0; i<n; i++){
+                    const size_t rem = tasks[i].remaining.load(std::memory_order_relaxed);
+                    if (!tasks[i].busy.load(std::memory_order_relaxed) && rem > 0){
+                        const double t = tasks[i].chunk_time.load(std::memory_order_relaxed);
+                        const double cost = (t > 0) ? t*rem : std::numeric_limits<double>::infinity();
+                        if (cost > best_cost){
+                            best = i;
+                            best_cost = cost;
+                        }
+                    }
+                }
+                bool expected = false;
+                if (best == n || !tasks[best].busy.compare_exchange_strong(expected, true)){
+                    //everything left is being updated by other threads
+                    if (reporter){
+                        report();
+                    }
+                    std::this_thread::sleep_for(std::chrono::microseconds(reporter ? 1000 : 50));
+                    continue;
+                }
+                Task& task = tasks[best];
+                const size_t k = std::min(chunk_steps, task.remaining.load());
+                if (k == 0){
+                    task.busy = false;
+                    continue;
+                }
+                task.remaining -= k;
+                unclaimed -= k;
+                const double t = omp_get_wtime();
+                obj[best]->update(method, k, sweeps);
+                task.chunk_time = (omp_get_wtime()-t)/k*chunk_steps;
+                task.busy = false;
+                done += k;
+                if (reporter){
+                    report();
+                }
+            }
+        }
+        catch (...){
+            #pragma omp critical
+            {
+                if (error == nullptr){
+                    error = std::current_exception();
+                }
+            }
+            stop = true;
+        }
+    }
+
+    if (error != nullptr){
+        std::rethrow_exception(error);
+    }
+    if (!cancelled()){
+        report();
+    }
+}
+
+
+ChainCounters total_counters(const std::vector<MonteCarlo*>& obj){
+    ChainCounters res;
+    for (const MonteCarlo* sim : obj){
+        res += sim->counters();
     }
+    return res;
+}
+
+AsyncJob::AsyncJob(const Work& work){
+    _thread = std::thread([this, work](){
+        try{
+            work([this](const size_t& done, const size_t& total){
+                _done = done;
+                _total = total;
+                return !_cancel.load();
+            }, &_cancel);
+        }
+        catch (...){
+            _error = std::current_exception();
+        }
+        std::lock_guard<std::mutex> lock(_mutex);
+        _finished = true;
+        _cv.notify_all();
+    });
+}
+
+AsyncJob::~AsyncJob(){
+    this->cancel();
+    this->_join();
+}
+
+bool AsyncJob::wait(const double& timeout){
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (timeout < 0){
+        _cv.wait(lock, [this](){return _finished.load();});
+    }
+    else{
+        _cv.wait_for(lock, std::chrono::duration<double>(timeout), [this](){return _finished.load();});
+    }
+    return _finished.load();
+}
+
+void AsyncJob::result(){
+    this->wait();
+    if (_error != nullptr){
+        std::rethrow_exception(_error);
+    }
+}
+
+void AsyncJob::_join(){
+    if (_thread.joinable()){
+        _thread.join();
+    }
+}
+
+std::unique_ptr<AsyncJob> update_all_async(const std::vector<MonteCarlo*>& obj, const std::string& method, const size_t& steps, const size_t& sweeps, int threads, const size_t& chunk){
+    return std::make_unique<AsyncJob>([=](const ProgressCallback& progress, std::atomic<bool>* cancel){
+        update_all(obj, method, steps, sweeps, threads, chunk, progress, cancel);
+    });
 }
\ No newline at end of file
@@ -3,18 +3,175 @@
 
 
 #include "tools.hpp"
+#include "rng.hpp"
+#include "reweighting.hpp"
 #include <functional>
+#include <array>
+#include <bit>
 #include <random>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <optional>
+#include <utility>
 
 
 using Observable = std::function<double(const State&)>;
 
+//Building with -DMCPY_NO_COUNTERS removes all counting code from the update methods
+#ifdef MCPY_NO_COUNTERS
+#define MCPY_COUNTERS false
+#else
+#define MCPY_COUNTERS true
+#endif
+
+struct ChainCounters;
+
+struct ErrorTarget;
+
+struct AdaptiveSchedule;
+
 class MarkovChain;
 
 class MonteCarlo;
 
+class AsyncJob;
+
 using propagator = void (MarkovChain::*)();
 
+using kernel = void (*)(MarkovChain& chain, const size_t& steps); //runs many steps of one update method, with the method known at compile time
+
+struct UpdateMethod;
+
+using ChainObservable = std::function<double(const MarkovChain&)>;
+
+using BatchObservable = std::function<std::vector<double>(const Trajectory&)>; //evaluates an observable on all snapshots of a trajectory at once
+
+using ProgressCallback = std::function<bool(const size_t& done, const size_t& total)>; //receives the number of completed steps. Returning false cancels the remaining work
+
+constexpr uint32_t CHECKPOINT_VERSION = 4; //increased whenever the checkpoint layout changes
+
+void save_rng(BinaryWriter& out, const Philox& gen); //the full position of the generator, so that a loaded one continues with exactly the same numbers
+
+Philox load_rng(BinaryReader& in);
+
+template<class Chain, void (Chain::*Method)()>
+void run_method(MarkovChain& chain, const size_t& steps){
+    //the method is a template argument, so it is inlined in the loop instead of being called through a pointer on every step
+    Chain& c = static_cast<Chain&>(chain);
+    for (size_t i=0; i<steps; i++){
+        (c.*Method)();
+    }
+}
+
+struct ChainCounters{
+
+    /*
+    Work done by a chain while counting is enabled (see MarkovChain::set_counting).
+    proposals and accepted count single-site Metropolis moves. Cluster updates count their clusters instead,
+    with a histogram of their sizes in powers of two: cluster_sizes[k] counts clusters of 2^k to 2^(k+1)-1 sites.
+    The times are measured by MonteCarlo::update: stepping the chain, evaluating the observables, and copying states into the trajectory.
+    */
+
+    uint64_t proposals = 0;
+    uint64_t accepted = 0;
+    uint64_t clusters = 0;
+    uint64_t cluster_sites = 0; //total size of all clusters
+    std::array<uint64_t, 64> cluster_sizes = {};
+    double update_seconds = 0;
+    double measure_seconds = 0;
+    double store_seconds = 0;
+
+    inline void add_cluster(const uint64_t& size){
+        clusters++;
+        cluster_sites += size;
+        cluster_sizes[std::bit_width(size)-1]++;
+    }
+
+    inline double acceptance() const{ return (proposals > 0) ? double(accepted)/proposals : 0;}
+
+    inline double mean_cluster_size() const{ return (clusters > 0) ? double(cluster_sites)/clusters : 0;}
+
+    ChainCounters& operator+=(const ChainCounters& other);
+};
+
+struct ErrorTarget{
+
+    std::string observable; //name of a registered observable, or of a built-in one (which is then registered)
+    double error; //requested (binned) error bar
+};
+
+struct AdaptiveSchedule{
+
+    //outcome of MonteCarlo::update_adaptive
+
+    size_t sweeps = 0; //chosen number of sweeps between measurements (as in update())
+    size_t steps = 0; //measurements taken
+    size_t calibration_updates = 0; //updates of the chain spent estimating the autocorrelation time (no measurements are kept)
+    std::vector<double> tau = {}; //integrated autocorrelation time of every target, in updates of the chain
+    std::vector<double> error = {}; //final error bar of every target
+    bool reached = false; //all targets reached their error before max_steps
+};
+
+enum class ChainQuantity : uint8_t{None, Energy, M, AbsM, M2}; //the built-in observables "energy", "M", "|M|" and "M^2" of chains that keep their running energy() and magnetization()
+
+ChainQuantity chain_quantity(const std::string& name); //None if the name is not one of them
+
+inline double chain_quantity_value(const ChainQuantity& q, const double& E, const double& M){
+    switch (q){
+        case ChainQuantity::Energy: return E;
+        case ChainQuantity::M: return M;
+        case ChainQuantity::AbsM: return std::abs(M);
+        case ChainQuantity::M2: return M*M;
+        default: return std::nan("");
+    }
+}
+
+template<class Chain, void (Chain::*Method)()>
+void run_measured(MarkovChain& chain, const size_t& steps, const size_t& sweeps, const ChainQuantity* q, BinningAccumulator* acc, const size_t& n_obs, JointHistogram* hist, Trajectory* data){
+    //the step/measure loop of MonteCarlo::update for observables that are all chain quantities: the update method, energy() and magnetization() are inlined,
+    //and no std::function is called. Each step performs sweeps+1 updates, then the observables (and histogram) are measured and the state is stored
+    Chain& c = static_cast<Chain&>(chain);
+    for (size_t i=0; i<steps; i++){
+        for (size_t s=0; s<=sweeps; s++){
+            (c.*Method)();
+        }
+        const double E = c.energy(), M = c.magnetization();
+        for (size_t k=0; k<n_obs; k++){
+            acc[k].add(chain_quantity_value(q[k], E, M));
+        }
+        if (hist != nullptr){
+            hist->add(E, M);
+        }
+        if (data != nullptr){
+            data->append(c.state());
+        }
+    }
+}
+
+using measured_kernel = void (*)(MarkovChain& chain, const size_t& steps, const size_t& sweeps, const ChainQuantity* q, BinningAccumulator* acc, const size_t& n_obs, JointHistogram* hist, Trajectory* data);
+
+struct UpdateMethod{
+
+    //an update method of a chain, as batches of steps with the method known at compile time.
+    //measured is the same loop with the chain quantities measured after every step, if the chain provides them (nullptr otherwise)
+
+    kernel run;
+    measured_kernel measured;
+};
+
+template<class Chain, void (Chain::*Method)()>
+inline UpdateMethod static_method(){
+    if constexpr (requires(const Chain& c){ c.energy(); c.magnetization();}){
+        return {&run_method<Chain, Method>, &run_measured<Chain, Method>};
+    }
+    else{
+        return {&run_method<Chain, Method>, nullptr};
+    }
+}
+
+
 class MarkovChain{
 
     //Base abstract class representing any Markov chain.
@@ -26,36 +183,65 @@ public:
 
     inline const State& state()const{ return *_state;}
 
-    virtual ~MarkovChain(){delete _state;}
+    inline std::shared_ptr<const State> shared_state() const{ return _state;} //keeps the current state object alive, even after the chain replaces it or is destroyed (e.g. for views of its configuration)
+
+    virtual ~MarkovChain(){}
     
-    virtual propagator method(const std::string& name) const = 0;
+    virtual UpdateMethod method(const std::string& name) const = 0; //throws if the name is unknown, or the method cannot be used with the current state
 
     virtual MarkovChain* clone() const = 0;
 
     virtual std::unique_ptr<MarkovChain> safe_clone() const = 0;
 
-    inline void update(const std::string& method, const size_t& steps=1){ this->update(this->method(method), steps);}
+    inline void update(const std::string& method, const size_t& steps=1){ this->method(method).run(*this, steps);}
+
+    virtual void seed(const uint64_t& seed, const uint64_t& stream); //restarts the random numbers of the chain from the given seed and stream
+
+    inline const Philox& rng() const{ return _gen;}
+
+    inline bool counting() const{ return MCPY_COUNTERS && _counting;} //always false if the counters are compiled out
+
+    inline void set_counting(const bool& on){ _counting = on;}
+
+    inline const ChainCounters& counters() const{ return _counters;}
+
+    inline ChainCounters& counters(){ return _counters;}
+
+    inline void reset_counters(){ _counters = ChainCounters();}
+
+    virtual size_t memory() const; //bytes held by the chain: its state and any work buffers (by default, the snapshot size of the state)
+
+    //Checkpoint of the chain: the state, the random stream and any parameters.
+    //Derived classes write a tag with their name first, and then call the base implementation.
+
+    virtual void save(BinaryWriter& out) const;
+
+    virtual void load(BinaryReader& in);
 
     void update(propagator method, const size_t& steps);
 
+    void reuse_state(MarkovChain& previous); //if previous has a state of the same shape, the configuration of this chain is copied into that state object, which this chain then keeps, so that views of it follow this chain
+
 protected:
 
-    MarkovChain(const State& initial_state):_state(initial_state.clone()), _gen(std::random_device()()), _uniform_dist(0, 1){}
+    MarkovChain(const State& initial_state):_state(initial_state.clone()), _gen(){}
 
-    MarkovChain(const MarkovChain& other):_state(other._state->clone()), _gen(other._gen), _uniform_dist(other._uniform_dist){}
+    //a copy continues with a new independent random stream (with the same seed)
+    MarkovChain(const MarkovChain& other):_state(other._state->clone()), _gen(other._gen.seed(), next_stream()), _counters(other._counters), _counting(other._counting){}
 
-    MarkovChain(MarkovChain&& other):_state(std::move(other._state)), _gen(std::move(other._gen)), _uniform_dist(std::move(other._uniform_dist)){}
+    //the moved-from chain gives up its state
+    MarkovChain(MarkovChain&& other):_state(std::move(other._state)), _gen(std::move(other._gen)), _counters(other._counters), _counting(other._counting){}
 
     MarkovChain& operator=(const MarkovChain& other);
 
     double draw_uniform(const double& a, const double& b);
 
-    State* _state;
-    mutable std::mt19937 _gen;
+    void fill_uniform(double* out, const size_t& n); //n uniform numbers in [0, 1), for update kernels that consume them in bulk
 
-private:
-    
-    mutable std::uniform_real_distribution<> _uniform_dist;
+    std::shared_ptr<State> _state;
+    mutable Philox _gen;
+    ChainCounters _counters;
+    bool _counting = false;
 };
 
 
@@ -71,39 +257,198 @@ public:
 
     MonteCarlo(const MarkovChain& mc):_mc(mc.clone()){}
 
-    MonteCarlo(const MonteCarlo& other): _mc(other._mc->clone()), _data(copy_states(other._data)){}
+    MonteCarlo(const MonteCarlo& other): _mc(other._mc->clone()), _data(other._data), _obs_names(other._obs_names), _obs(other._obs), _obs_q(other._obs_q), _acc(other._acc), _store_states(other._store_states), _hist(other._hist), _hist_E(other._hist_E), _hist_M(other._hist_M){}
 
-    MonteCarlo(MonteCarlo&& other): _mc(other._mc), _data(std::move(other._data)){}
+    MonteCarlo(MonteCarlo&& other): _mc(std::exchange(other._mc, nullptr)), _data(std::move(other._data)), _obs_names(std::move(other._obs_names)), _obs(std::move(other._obs)), _obs_q(std::move(other._obs_q)), _acc(std::move(other._acc)), _store_states(other._store_states), _hist(std::move(other._hist)), _hist_E(std::move(other._hist_E)), _hist_M(std::move(other._hist_M)){}
 
     virtual ~MonteCarlo();
 
     MonteCarlo& operator=(const MonteCarlo& other);
 
-    std::vector<const State*> data() const;
+    std::vector<std::unique_ptr<State>> data() const; //copies of all stored states
+
+    std::unique_ptr<State> state(const size_t& i) const;
 
-    inline const State& state(const size_t& i) const{return *_data.at(i);}
+    inline size_t N() const{return _data.N();}
 
-    inline size_t N() const{return _data.size();}
+    inline const Trajectory& trajectory() const{return _data;}
 
-    Sample sample(const Observable A) const;
+    Sample sample(const Observable& A, int threads=1) const; //A is evaluated on every stored state. Use threads != 1 only if A is thread safe
+
+    Sample sample(const std::string& name, int threads=-1) const; //a built-in observable is evaluated on every stored state in parallel
+
+    Sample batch_sample(const BatchObservable& A) const;
 
     void update(const std::string& method, const size_t& steps, const size_t& sweeps=0);
 
     inline void thermalize(const std::string& method, const size_t& sweeps){this->_mc->update(method, sweeps);}
 
+    /*
+    update() with the measurement interval and the number of steps chosen automatically.
+    First, the integrated autocorrelation time of the targets is estimated from the binning levels of "calibration" measurements
+    (repeated with a longer interval while the estimate is unreliable), and the interval is set to about one autocorrelation time,
+    capped at max_sweeps. Then steps are added in growing rounds until every target has a reliable binned error below its goal,
+    or max_steps measurements have been taken. Existing statistics of the observables are kept and continued.
+    */
+    AdaptiveSchedule update_adaptive(const std::string& method, const std::vector<ErrorTarget>& targets, const size_t& max_steps, const size_t& calibration=1024, const size_t& max_sweeps=10000);
+
     inline const MarkovChain& chain() const{return *this->_mc;}
 
+    inline void seed(const uint64_t& seed, const uint64_t& stream){this->_mc->seed(seed, stream);}
+
+    inline void set_counting(const bool& on){this->_mc->set_counting(on);}
+
+    inline const ChainCounters& counters() const{return this->_mc->counters();}
+
+    inline void reset_counters(){this->_mc->reset_counters();}
+
+    void add_observable(const std::string& name, const Observable& A);
+
+    void add_observable(const std::string& name, const ChainObservable& A);
+
+    void add_observable(const std::string& name); //registers one of the built-in observables of the simulation
+
+    const BinningAccumulator& observable(const std::string& name) const;
+
+    inline const std::vector<std::string>& observables() const{return _obs_names;}
+
+    void reset_observables();
+
+    inline const bool& store_states() const{return _store_states;}
+
+    inline void set_store_states(const bool& store){_store_states = store;}
+
+    inline void reserve_states(const size_t& steps){if (_store_states){_data.prepare(this->_mc->state(), steps);}} //room for the states of steps more measurements, for runs that are split in several update() calls
+
+    //Joint histogram of the built-in "energy" and "M" observables, recorded at every measurement of update(), for reweighting (see Reweighting).
+    //T is the temperature of the simulation. Starting a new recording discards the previous histogram
+
+    void record_histogram(const double& T, const double& dE=1, const double& dM=1);
+
+    inline void stop_histogram(){_hist.reset();}
+
+    inline bool recording_histogram() const{return _hist.has_value();}
+
+    const JointHistogram& histogram() const;
+
+    /*
+    Checkpoint of the whole simulation: the chain (state, random stream, parameters), the statistics of the registered observables,
+    the recorded histogram and, if trajectory is true, the stored states. A trajectory in a file is saved as a reference to that file,
+    which the loading simulation continues, unless the file is still written by another simulation (e.g. the saved one): then the stored states are copied in memory.
+    The simulation that loads a checkpoint must be of the same kind (its lattice size is taken from the checkpoint),
+    and continues exactly as the saved one would have. The observables are matched by name: observables that are not registered
+    yet are registered as built-in observables, so custom observables need to be registered before loading.
+    */
+
+    void save(const std::string& path, const bool& trajectory=true) const; //written to a temporary file first, so that an interrupted save never corrupts an existing checkpoint
+
+    void load(const std::string& path);
+
+    void save(std::ostream& out, const bool& trajectory=true) const;
+
+    void load(std::istream& in);
+
+    inline void set_trajectory_file(const std::string& path){_data.to_file(path);} //stored states are streamed to an append-only file instead of memory
+
+    inline std::string trajectory_file() const{return _data.file();}
+
 
 protected:
 
-    void _clear_states();
+    void _measure();
+
+    void _timed_update(const UpdateMethod& m, const size_t& steps, const size_t& sweeps); //update() while the chain is counting
+
+    virtual Observable _builtin_observable(const std::string& name) const;
+
+    virtual ChainObservable _builtin_chain_observable(const std::string& name) const; //used when a built-in observable is registered. By default, the observable is evaluated on the state of the chain
+
+    virtual bool _chain_quantities() const{return false;} //true if the built-in chain quantities (see ChainQuantity) are the energy() and magnetization() of the chain, so that update() can measure them in the static kernels
+
+    void _add_observable(const std::string& name, const ChainObservable& A, const ChainQuantity& q);
 
     MarkovChain* _mc = nullptr; //pointer to dynamically allocated markov chain that propagates the simulation. This is passed from derived classes to the constructor of this class
-    std::vector<State*> _data = {}; //vector that holds all states obtained from the Markov chain to use for our statistics
+    Trajectory _data = {}; //snapshots of all states obtained from the Markov chain to use for our statistics
+
+    //observables registered up front. They are evaluated right after each step of update(), and only their running binning statistics are kept.
+    std::vector<std::string> _obs_names = {};
+    std::vector<ChainObservable> _obs = {};
+    std::vector<ChainQuantity> _obs_q = {}; //the chain quantity that each observable is, or None
+    std::vector<BinningAccumulator> _acc = {};
+    bool _store_states = true; //if false, update() does not keep any states, only the registered observables are accumulated
+    std::optional<JointHistogram> _hist = {};
+    ChainObservable _hist_E = nullptr;
+    ChainObservable _hist_M = nullptr;
 };
 
 
-void update_all(const std::vector<MonteCarlo*>& obj, const std::string& method, const size_t& steps, const size_t& sweeps, int threads);
+/*
+Performs obj[i]->update(method, steps, sweeps) for all simulations in parallel.
+Every update is split into chunks of "chunk" steps (if chunk = 0, 16 chunks per simulation).
+Whenever a thread becomes idle, it picks up the next chunk of the simulation with the most estimated remaining work
+that is not being updated by another thread, so that a batch of very different simulations keeps all threads busy.
+The progress callback is only called from the calling thread, and the run can be cancelled through it or through the cancel flag
+between chunks.
+*/
+void update_all(const std::vector<MonteCarlo*>& obj, const std::string& method, const size_t& steps, const size_t& sweeps, int threads, const size_t& chunk=0, const ProgressCallback& progress=nullptr, std::atomic<bool>* cancel=nullptr);
+
+
+ChainCounters total_counters(const std::vector<MonteCarlo*>& obj); //sum of the counters of all simulations, e.g. after update_all
+
+
+class AsyncJob{
+
+    /*
+    Runs a long computation in a background thread and returns immediately.
+    The work receives a progress callback and a cancellation flag (see update_all).
+    Destroying the job cancels the work and waits for the thread to finish.
+    */
+
+public:
+
+    using Work = std::function<void(const ProgressCallback&, std::atomic<bool>*)>;
+
+    AsyncJob(const Work& work);
+
+    AsyncJob(const AsyncJob&) = delete;
+
+    AsyncJob& operator=(const AsyncJob&) = delete;
+
+    virtual ~AsyncJob();
+
+    inline bool done() const{ return _finished.load();}
+
+    bool wait(const double& timeout=-1); //waits at most timeout seconds (forever if negative) and returns done()
+
+    inline void cancel(){ _cancel = true;}
+
+    inline bool cancelled() const{ return _cancel.load();}
+
+    inline size_t steps_done() const{ return _done.load();}
+
+    inline size_t total_steps() const{ return _total.load();}
+
+    inline double progress() const{ return (_total.load() > 0) ? double(_done.load())/_total.load() : 0;}
+
+    void result(); //waits for the work to finish, and rethrows the exception it raised, if any
+
+protected:
+
+    void _join();
+
+private:
+
+    std::atomic<size_t> _done{0};
+    std::atomic<size_t> _total{0};
+    std::atomic<bool> _cancel{false};
+    std::atomic<bool> _finished{false};
+    std::exception_ptr _error = nullptr;
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::thread _thread;
+};
+
+std::unique_ptr<AsyncJob> update_all_async(const std::vector<MonteCarlo*>& obj, const std::string& method, const size_t& steps, const size_t& sweeps, int threads, const size_t& chunk=0);
 
 
 
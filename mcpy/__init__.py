@@ -1 +1,20 @@
-from .mcpy import * #type: ignore
\ No newline at end of file
+from .mcpy import * #type: ignore
+from .mcpy import AsyncJob as _AsyncJob #type: ignore
+import asyncio as _asyncio
+
+
+async def _wait_async(job: _AsyncJob, poll: float = 0.05):
+    #the job runs without the GIL, so the event loop only needs to poll it
+    while not job.done():
+        await _asyncio.sleep(poll)
+    job.result()
+
+
+_AsyncJob.__await__ = lambda self: _wait_async(self).__await__()
+
+
+def benchmark(model: str = "ising2d", methods: list[str]|None = None, L=(16, 32, 64, 128), T=(2.269,), threads=(1,), min_time: float = 0.2, seed: int = 0)->dict:
+    #throughput of the update methods of a model (see mcpy.mcpy._benchmark), as a dict {"max_threads": int, "results": [dict, ...]}
+    from .mcpy import _benchmark #type: ignore
+    import json
+    return json.loads(_benchmark(model, methods, L, T, threads, min_time, seed))
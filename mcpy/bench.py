@@ -0,0 +1,31 @@
+#python -m mcpy.bench --model ising2d --L 16,32,64 --threads 1,4 --out bench.json
+import argparse
+import json
+from . import benchmark
+
+
+def _list(kind):
+    return lambda s: [kind(x) for x in s.split(",")]
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Throughput of the Monte Carlo update methods")
+    parser.add_argument("--model", default="ising2d", choices=["ising2d", "packed", "ising3d", "potts3", "xy2d"])
+    parser.add_argument("--methods", type=_list(str), default=None, help="comma separated (default: all methods of the model)")
+    parser.add_argument("--L", type=_list(int), default=[16, 32, 64, 128])
+    parser.add_argument("--T", type=_list(float), default=[2.269])
+    parser.add_argument("--threads", type=_list(int), default=[1], help="1: a single chain, n > 1: n simulations through update_all")
+    parser.add_argument("--min-time", type=float, default=0.2)
+    parser.add_argument("--seed", type=int, default=0)
+    parser.add_argument("--out", default=None)
+    args = parser.parse_args()
+    report = json.dumps(benchmark(args.model, args.methods, args.L, args.T, args.threads, args.min_time, args.seed), indent=1)
+    if args.out is None:
+        print(report)
+    else:
+        with open(args.out, "w") as f:
+            f.write(report)
+
+
+if __name__ == "__main__":
+    main()
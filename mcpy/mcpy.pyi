@@ -5,6 +5,7 @@ import numpy as np
 '''
 Stub file to assist type hinting of python front end.
 All operations are compiled in c++ code and have been exposed to python.
+Long running methods (update, thermalize, update_all...) release the GIL.
 
 The source code is located in the header files accompanied,
 and the implementations in the cpp files.
@@ -74,6 +75,210 @@ class BinnedSample:
 
 
 
+class Accumulator:
+
+    '''
+    Running statistics of an observable that has been registered in a MonteCarlo object.
+    Measured values are not stored, only their count, mean and sum of squared deviations (Welford),
+    so that the statistics of several accumulators can be merged exactly.
+    '''
+
+    @property
+    def N(self)->int:...
+
+    @property
+    def stat(self)->str:...
+
+    def mean(self)->float:...
+
+    def std(self)->float:...
+
+    def merge(self, other: Accumulator)->None:... #adds the values of other, as if they had been added here
+
+    def popul_std(self)->float:...
+
+    def error(self)->float:...
+
+
+
+class BinningAccumulator:
+
+    '''
+    Streaming binning analysis. Values are added one at a time,
+    and only O(log N) numbers are stored. All properties can be queried at any moment,
+    e.g. to monitor autocorrelations while a simulation is running.
+    Only levels with at least min_bins bins are reliable and counted in max_level.
+    '''
+
+    def __init__(self, min_bins=64):...
+
+    def add(self, x: float)->None:...
+
+    @property
+    def N(self)->int:...
+
+    def mean(self)->float:...
+
+    def std(self)->float:...
+
+    def error(self, level=0)->float:...
+
+    def binned_error(self)->float:... #error of the highest reliable level
+
+    @property
+    def max_level(self)->int:...
+
+    @property
+    def converged(self)->bool:...
+
+    @property
+    def tau_estimate(self)->float:...
+
+    @property
+    def levels(self)->list[Accumulator]:...
+
+    def reset(self)->None:...
+
+
+
+class ResampleResult:
+
+    @property
+    def estimate(self)->float:... #derived quantity of the means of the whole sample
+
+    @property
+    def value(self)->float:... #bias corrected estimate
+
+    @property
+    def bias(self)->float:...
+
+    @property
+    def error(self)->float:...
+
+    @property
+    def stat(self)->str:...
+
+
+
+class Resampler:
+
+    '''
+    Jackknife and bootstrap errors of quantities derived from several series measured together (entry i of every series from the same measurement).
+    The series are reduced to block means of bin_size entries first, so bin_size should exceed the autocorrelation time.
+    f receives the means of all series as an array, e.g. lambda m: m[1] - m[0]**2 for the series (E, E**2).
+    '''
+
+    def __init__(self, series: Iterable[np.ndarray], bin_size=1):...
+
+    @property
+    def series(self)->int:...
+
+    @property
+    def blocks(self)->int:...
+
+    @property
+    def means(self)->np.ndarray:...
+
+    def jackknife(self, f: Callable[[np.ndarray], float])->ResampleResult:...
+
+    def bootstrap(self, f: Callable[[np.ndarray], float], resamples=1000, seed=0)->ResampleResult:... #seed=0 uses the global seed and a new random stream on every call
+
+
+
+class JointHistogram:
+
+    '''
+    Counts of the (energy, magnetization) pairs measured at temperature T, in bins of width dE and dM. Only visited bins are stored.
+    '''
+
+    def __init__(self, T=1., dE=1., dM=1.):...
+
+    def add(self, E: float, M: float)->None:...
+
+    def merge(self, other: JointHistogram)->None:... #same T and bin widths
+
+    @property
+    def T(self)->float:...
+
+    @property
+    def dE(self)->float:...
+
+    @property
+    def dM(self)->float:...
+
+    @property
+    def N(self)->int:... #number of measurements
+
+    @property
+    def size(self)->int:... #number of visited bins
+
+    @property
+    def bins(self)->np.ndarray:... #(size, 3) array of E, M, count, sorted by E and then M
+
+    def reset(self)->None:...
+
+
+
+class Reweighting:
+
+    '''
+    Thermal averages at any temperature from histograms measured at one (Ferrenberg-Swendsen) or more (multi-histogram, WHAM) temperatures,
+    on a lattice of N sites. Only reliable where the energy distribution is well covered by the histograms.
+    The results are dictionaries with T, energy (per site), specific_heat, abs_M (per site), M2 (per site^2), susceptibility, binder_cumulant and log_Z.
+    '''
+
+    def __init__(self, histograms: Iterable[JointHistogram], N: int, tol=1e-10, max_iter=100000):...
+
+    def at(self, T: float)->dict[str, float]:...
+
+    def curve(self, T: Iterable[float])->dict[str, np.ndarray]:... #all temperatures in parallel, one array per quantity
+
+    @property
+    def free_energies(self)->np.ndarray:... #-log Z of every histogram, relative to the first one
+
+    @property
+    def iterations(self)->int:...
+
+    @property
+    def log_g(self)->np.ndarray:... #log density of states of every bin, up to a constant
+
+    @property
+    def bins(self)->np.ndarray:... #union of the visited bins, as in JointHistogram.bins
+
+
+
+class AsyncJob:
+
+    '''
+    Handle of a simulation that runs in a background thread, returned immediately by the *_async functions.
+    The simulations involved must not be used until the job is done.
+    The job can be awaited inside asyncio code. Deleting the handle cancels the job.
+    '''
+
+    def done(self)->bool:...
+
+    def wait(self, timeout: float|None = None)->bool:... #returns done()
+
+    def cancel(self)->None:... #the work stops at the end of the current chunk
+
+    def result(self)->None:... #waits, and raises the exception of the job, if any
+
+    @property
+    def cancelled(self)->bool:...
+
+    @property
+    def progress(self)->float:... #fraction of completed steps
+
+    @property
+    def steps_done(self)->int:...
+
+    @property
+    def total_steps(self)->int:...
+
+    def __await__(self):...
+
+
+
 class STATE:
     '''
     Base class for any Markov Chain State.
@@ -92,7 +297,7 @@ class SpinState(STATE):
     def __call__(self, i: int, j: int)->int:...
 
     @property
-    def spins(self)->np.ndarray[int]:... #2D lattice of spins +1 / -1
+    def spins(self)->np.ndarray[int]:... #2D lattice of spins +1 / -1 (read-only view, no copy)
 
     @property
     def sites(self)->int:... #number of sites
@@ -103,6 +308,35 @@ class SpinState(STATE):
     @property
     def energy(self)->float:... #total energy
 
+    def structure_factor(self, nx: int, ny: int)->float:... #|sum_r s_r exp(iq*r)|^2 / N, with q = 2pi*(nx/Lx, ny/Ly)
+
+
+
+class PackedSpinState(STATE):
+    '''
+    Spin lattice with one bit per spin. Lx must be a multiple of 64
+    '''
+
+    def __init__(self, state: SpinState):...
+
+    def __call__(self, i: int, j: int)->int:...
+
+    def unpack(self)->SpinState:...
+
+    @property
+    def spins(self)->np.ndarray[int]:... #2D lattice of spins +1 / -1 (unpacked copy)
+
+    @property
+    def sites(self)->int:...
+
+    @property
+    def M(self)->float:...
+
+    @property
+    def energy(self)->float:...
+
+    def structure_factor(self, nx: int, ny: int)->float:...
+
 
 
 class MarkovChain:
@@ -112,18 +346,103 @@ class MarkovChain:
 
     def update(self, method: str, steps=1)->None:...
 
+    #restarts the random numbers of the chain. Chains with the same seed and different streams are independent
+    def seed(self, seed: int, stream=0)->None:...
+
+    @property
+    def seed_value(self)->int:...
+
+    @property
+    def stream(self)->int:...
+
+    #Counters of the work done by the chain, kept while counting is True (off by default, and removed entirely in builds with -DMCPY_NO_COUNTERS):
+    #proposals, accepted, acceptance (single-site moves), clusters, mean_cluster_size, cluster_sizes (cluster_sizes[k]: clusters of 2^k to 2^(k+1)-1 sites),
+    #and update_seconds, measure_seconds, store_seconds (time spent in MonteCarlo.update stepping the chain, measuring observables and storing states)
+    @property
+    def counting(self)->bool:...
+
+    @counting.setter
+    def counting(self, on: bool)->None:...
+
+    @property
+    def counters(self)->dict:...
+
+    def reset_counters(self)->None:...
+
 
 class IsingModel2DMarkovChain(MarkovChain):
 
-    def __init__(self, T: float, Lx: int, Ly: int):...
+    '''
+    E = -Jx sum s_i s_(i+x) - Jy sum s_i s_(i+y) - h sum s_i. The Metropolis updates use a table of acceptance thresholds
+    that is rebuilt whenever Temp, the couplings or h change. The cluster updates require h = 0 and non negative couplings.
+    '''
+
+    def __init__(self, T: float, Lx: int, Ly: int, Jx=1., Jy=1., h=0.):...
+
+    @property
+    def Jx(self)->float:...
+
+    @property
+    def Jy(self)->float:...
+
+    @property
+    def h(self)->float:...
+
+    @h.setter
+    def h(self, h: float)->None:...
+
+    def set_couplings(self, Jx: float, Jy: float)->None:...
+
+    @property
+    def state(self)->SpinState:... #copy of the current state
+
+    @property
+    def spins(self)->np.ndarray[int]:... #live read-only view of the current spins
+
+    @property
+    def energy(self)->float:... #energy of the current state, tracked by the updates without rescanning the lattice
 
     @property
-    def state(self)->SpinState:...
+    def M(self)->float:... #magnetization of the current state, tracked the same way
 
     def ssf_update(self)->None:...
 
     def wolff_update(self)->None:...
 
+    def sw_update(self)->None:... #Swendsen-Wang update, parallelized over .threads
+
+    def checkerboard_update(self)->None:... #one full lattice sweep, red sublattice first and then black. Requires even Lx, Ly
+
+    def parallel_checkerboard_update(self)->None:... #same as checkerboard_update, with the lattice split in strips updated by different threads
+
+    @property
+    def threads(self)->int:... #number of strips/threads used by parallel_checkerboard_update and sw_update
+
+    @threads.setter
+    def threads(self, threads: int)->None:... #threads <= 0 uses all available threads
+
+
+
+class PackedIsingModel2DMarkovChain(MarkovChain):
+
+    '''
+    Multi-spin coding Ising chain: the Metropolis acceptance of 64 spins is evaluated at once with bitwise logic.
+    Lx must be a multiple of 64 and Ly must be even.
+    '''
+
+    def __init__(self, T: float, Lx: int, Ly: int):...
+
+    @property
+    def state(self)->PackedSpinState:...
+
+    @property
+    def energy(self)->float:...
+
+    @property
+    def M(self)->float:...
+
+    def msc_update(self)->None:... #one full lattice sweep
+
 
 
 class MonteCarlo:
@@ -131,21 +450,106 @@ class MonteCarlo:
     def __init__(self, markov_chain: MarkovChain): ...
 
     @property
-    def data(self)->list[STATE]:...
+    def data(self)->list[STATE]:... #copies of the stored states
+
+    #All stored states as one read-only array of shape (N, *state_shape), without copying.
+    #The array stays valid and unchanged after further updates (which do not show up in it) or after the simulation is deleted
+    @property
+    def trajectory(self)->np.ndarray:...
 
     @property
     def N(self)->int:...
 
-    def sample(self, A: OBSERVABLE)->Sample:...
+    #A can also be the name of a built-in observable (e.g. "energy", "M", "|M|", "M^2", "structure_factor" for spin models),
+    #which is evaluated natively with the given number of threads
+    def sample(self, A: OBSERVABLE|str, threads=-1)->Sample:...
+
+    #A receives .trajectory, and returns N values
+    def batch_sample(self, A: Callable[[np.ndarray], Iterable[float]])->Sample:...
 
     def update(self, method: str, steps: int, sweeps=0):...
 
     def thermalize(self, method: str, sweeps: int):...
 
+    #.update() with the sweeps between measurements and the number of steps chosen automatically.
+    #errors maps observable names to the requested error bars (unregistered names are registered as built-in observables).
+    #The autocorrelation time is estimated from "calibration" measurements, the interval is set to about one autocorrelation time (at most max_sweeps),
+    #and steps are added until every error bar is reached or max_steps measurements were taken.
+    #Returns {"sweeps", "steps", "calibration_updates", "tau": {name: tau in updates}, "error": {name: error}, "reached": bool}
+    def update_adaptive(self, method: str, errors: dict[str, float], max_steps: int, calibration=1024, max_sweeps=10000)->dict:...
+
+    def seed(self, seed: int, stream=0)->None:... #restarts the random numbers of the chain
+
+    #counters of the chain (see MarkovChain.counters)
+    @property
+    def counting(self)->bool:...
+
+    @counting.setter
+    def counting(self, on: bool)->None:...
+
+    @property
+    def counters(self)->dict:...
+
+    def reset_counters(self)->None:...
+
+    #joint histogram of the built-in energy and M, recorded at every measurement of update (T: temperature of the simulation)
+    def record_histogram(self, T: float, dE=1., dM=1.)->None:...
+
+    def stop_histogram(self)->None:...
+
+    @property
+    def recording_histogram(self)->bool:...
+
+    @property
+    def histogram(self)->JointHistogram:...
+
+    def update_async(self, method: str, steps: int, sweeps=0, chunk=0)->AsyncJob:...
+
+    def thermalize_async(self, method: str, sweeps: int, chunk=0)->AsyncJob:...
+
+    #registers an observable that is evaluated right after every step of .update().
+    #If observable is None, a built-in observable of the simulation is registered (e.g. "energy", "M", "|M|", "M^2" for the Ising model).
+    #The built-in energy and magnetization observables read the values that the chain tracks during the updates, so they cost O(1) per measurement
+    def add_observable(self, name: str, observable: OBSERVABLE|None = None)->None:...
+
+    def observable(self, name: str)->BinningAccumulator:...
+
+    @property
+    def observables(self)->list[str]:...
+
+    def reset_observables(self)->None:...
+
+    @property
+    def store_states(self)->bool:... #if False, .update() only accumulates the registered observables and does not keep any states
+
+    @store_states.setter
+    def store_states(self, store: bool)->None:...
+
+    #Binary checkpoint of the simulation: the current state, the random stream, the parameters, the statistics of the registered observables,
+    #and the stored states if trajectory is True (a trajectory file is saved as a reference to the file).
+    #A simulation that loads a trajectory file continues it, unless another simulation still writes it (e.g. a pickled copy of a live simulation):
+    #then the stored states are copied in memory.
+    #A save never corrupts an existing checkpoint at path, even if the process is killed while saving.
+    def save(self, path: str, trajectory=True)->None:...
+
+    #Restores a checkpoint into a simulation of the same kind (the lattice size is taken from the checkpoint),
+    #which then continues exactly as the saved one would have.
+    #Custom observables need to be registered again before loading, built-in ones are registered automatically.
+    #Simulations can also be pickled, in the same format.
+    def load(self, path: str)->None:...
+
+    #If set, stored states are streamed to an append-only file that is mapped in memory, instead of being kept in RAM.
+    #The file can be read later with read_trajectory. Empty if the trajectory is in memory
+    @property
+    def trajectory_file(self)->str:...
+
+    @trajectory_file.setter
+    def trajectory_file(self, path: str)->None:...
+
 
 class IsingModel2D(MonteCarlo):
 
-    def __init__(self, T: float, Lx: int, Ly: int):...
+    def __init__(self, T: float, Lx: int, Ly: int, Jx=1., Jy=1., h=0.):... #couplings and field as in IsingModel2DMarkovChain
 
     @property
     def data(self)->list[SpinState]:...
@@ -153,10 +557,40 @@ class IsingModel2D(MonteCarlo):
     @property
     def Temp(self)->float:...
 
-    def sample(self, A: Callable[[SpinState], float])->Sample:...
+    @Temp.setter
+    def Temp(self, T: float)->None:...
+
+    @property
+    def Jx(self)->float:...
+
+    @property
+    def Jy(self)->float:...
+
+    @property
+    def h(self)->float:...
+
+    @h.setter
+    def h(self, h: float)->None:...
+
+    def set_couplings(self, Jx: float, Jy: float)->None:...
+
+    @property
+    def spins(self)->np.ndarray[int]:... #live read-only view of the current spins of the chain
+
+    @property
+    def energy(self)->float:... #current energy of the chain (O(1), no lattice scan)
+
+    @property
+    def M(self)->float:... #current magnetization of the chain (O(1))
+
+    def exchange_chain(self, other: IsingModel2D)->None:... #swaps configurations with another simulation, each one keeps its temperature, couplings, field and statistics
+
+    def sample(self, A: Callable[[SpinState], float]|str, threads=-1)->Sample:...
 
     def energy_sample(self)->Sample:...
 
+    def structure_factor_sample(self, nx: int, ny: int)->Sample:...
+
     def ssf_update(self, steps: int, sweeps=0)->None:...
 
     def wolff_update(self, steps: int, sweeps=0)->None:...
@@ -165,5 +599,223 @@ class IsingModel2D(MonteCarlo):
 
     def wolff_thermalize(self, sweeps: int)->None:...
 
-#perform many Monte Carlo simulations in parallel
-def update_all(sims: Iterable[MonteCarlo], method: str, steps: int, sweeps=0, threads=-1)->None:...
+    def sw_update(self, steps: int, sweeps=0)->None:...
+
+    def sw_thermalize(self, sweeps: int)->None:...
+
+    def checkerboard_update(self, steps: int, sweeps=0)->None:...
+
+    def checkerboard_thermalize(self, sweeps: int)->None:...
+
+    def parallel_checkerboard_update(self, steps: int, sweeps=0)->None:...
+
+    def parallel_checkerboard_thermalize(self, sweeps: int)->None:...
+
+    @property
+    def threads(self)->int:...
+
+    @threads.setter
+    def threads(self, threads: int)->None:...
+
+class PackedIsingModel2D(MonteCarlo):
+
+    def __init__(self, T: float, Lx: int, Ly: int):...
+
+    @property
+    def data(self)->list[PackedSpinState]:...
+
+    @property
+    def Temp(self)->float:...
+
+    @property
+    def energy(self)->float:...
+
+    @property
+    def M(self)->float:...
+
+    def sample(self, A: Callable[[PackedSpinState], float]|str, threads=-1)->Sample:...
+
+    def energy_sample(self)->Sample:...
+
+    def msc_update(self, steps: int, sweeps=0)->None:...
+
+    def msc_thermalize(self, sweeps: int)->None:...
+
+class LatticeModel(MonteCarlo):
+
+    '''
+    Lattice model whose geometry and spin type are fixed at compile time (see lattice.hpp).
+    The concrete classes below only differ in the shape they expect and the spin values:
+    Ising3D (simple cubic, 3 sizes, spins +-1), IsingTriangular (2 sizes, spins +-1),
+    Potts3 and Potts4 (square lattice, states 0...q-1), XY2D (square lattice, angles in radians).
+    All have periodic boundaries.
+    Built-in observables: "energy", "M", "|M|", "M^2" (M is the order parameter along state 0 for Potts, and the x component for XY)
+    '''
+
+    def __init__(self, T: float, shape: Iterable[int]):... #one positive integer size per lattice dimension
+
+    @property
+    def Temp(self)->float:...
+
+    @Temp.setter
+    def Temp(self, T: float)->None:...
+
+    @property
+    def energy(self)->float:...
+
+    @property
+    def M(self)->float:...
+
+    @property
+    def spins(self)->np.ndarray:... #copy of the current configuration
+
+    def ssf_update(self, steps: int, sweeps=0)->None:... #single random site per step
+
+    def ssf_thermalize(self, sweeps: int)->None:...
+
+    def sweep_update(self, steps: int, sweeps=0)->None:... #every site once per step, in memory order
+
+    def sweep_thermalize(self, sweeps: int)->None:...
+
+    def energy_sample(self)->Sample:...
+
+class Ising3D(LatticeModel):...
+
+class IsingTriangular(LatticeModel):...
+
+class Potts3(LatticeModel):...
+
+class Potts4(LatticeModel):...
+
+class XY2D(LatticeModel):...
+
+class ParallelTempering:
+
+    '''
+    Replica exchange over a ladder of IsingModel2D simulations.
+    sim(k) always has temperature .temperatures[k] and keeps the statistics of that temperature,
+    while the configurations travel along the ladder.
+    '''
+
+    def __init__(self, temperatures: Iterable[float], Lx: int, Ly: int):...
+
+    @property
+    def replicas(self)->int:...
+
+    @property
+    def temperatures(self)->np.ndarray:...
+
+    @property
+    def acceptance_rates(self)->np.ndarray:... #swap acceptance rate of each pair (k, k+1)
+
+    def sim(self, k: int)->IsingModel2D:...
+
+    def add_observable(self, name: str)->None:... #registers a built-in observable in every simulation
+
+    #each round, all simulations run .update(method, steps, sweeps) in parallel, and then an exchange is attempted
+    def update(self, method: str, rounds: int, steps=1, sweeps=0, threads=-1)->None:...
+
+    def exchange(self)->None:...
+
+    def tune(self)->None:... #makes acceptance rates more uniform, keeping the end temperatures fixed. Resets the observables and rates, and restarts recorded histograms
+
+    def reset_rates(self)->None:...
+
+class DensityOfStates:
+
+    '''
+    Density of states of a Wang-Landau run, normalized to 2^N states, with the microcanonical magnetization (NaN where never measured).
+    at and curve give the same dictionaries as Reweighting, with the absolute log_Z.
+    '''
+
+    def at(self, T: float)->dict[str, float]:...
+
+    def curve(self, T: Iterable[float])->dict[str, np.ndarray]:...
+
+    @property
+    def energies(self)->np.ndarray:...
+
+    @property
+    def log_g(self)->np.ndarray:...
+
+    @property
+    def abs_M(self)->np.ndarray:... #<|M|> at each energy
+
+    @property
+    def M2(self)->np.ndarray:...
+
+    @property
+    def M4(self)->np.ndarray:...
+
+    @property
+    def N(self)->int:...
+
+class WangLandau:
+
+    '''
+    Flat-histogram sampling of the Lx x Ly Ising model over [E_min, E_max] (the whole spectrum by default),
+    split in windows that overlap by a fraction overlap and are sampled in parallel.
+    run() performs the Wang-Landau stages (ln_f is halved whenever the histogram is flat) until ln_f < final_ln_f.
+    Wang-Landau saturates at a finite accuracy, which production() then improves with multicanonical sampling
+    at fixed weights, also measuring the magnetization at each energy.
+    A single run gives the thermodynamics at every temperature through density_of_states().
+    '''
+
+    def __init__(self, Lx: int, Ly: int, windows=1, overlap=0.5, E_min: int|None=None, E_max: int|None=None):...
+
+    @property
+    def windows(self)->int:...
+
+    @property
+    def sites(self)->int:...
+
+    @property
+    def ranges(self)->list[tuple[int, int]]:... #energy range of each window
+
+    @property
+    def ln_f(self)->np.ndarray:... #current modification factor of each window
+
+    def run(self, flatness=0.8, final_ln_f=1e-6, check_sweeps=100, max_sweeps=0, threads=-1)->bool:... #False if a window did not reach final_ln_f within max_sweeps (0: no limit). Raises if check_sweeps is 0, flatness is not in (0, 1], or final_ln_f <= 0 without max_sweeps
+
+    def production(self, sweeps: int, iterations=1, threads=-1)->None:...
+
+    def density_of_states(self)->DensityOfStates:...
+
+    @property
+    def counting(self)->bool:...
+
+    @counting.setter
+    def counting(self, on: bool)->None:...
+
+    @property
+    def counters(self)->dict:... #summed over the windows
+
+#Every Markov chain draws from its own stream of a counter-based generator (Philox4x32-10) with a common global seed.
+#After set_seed, all simulations that are created in the same order give identical results, regardless of threading.
+def set_seed(seed: int)->None:...
+
+#specific heat (<E^2>-<E>^2)/(N T^2), susceptibility (<M^2>-<|M|>^2)/(N T) and Binder cumulant 1-<M^4>/(3<M^2>^2)
+#from series of the total energy and magnetization, evaluated natively and in parallel.
+#Errors from the jackknife over blocks of bin_size entries, or from bootstrap resamples if bootstrap > 0
+def thermodynamics(E: np.ndarray, M: np.ndarray, T: float, N: int, bin_size=1, bootstrap=0, seed=0)->dict[str, ResampleResult]:...
+
+#sum of the counters of all simulations (e.g. after update_all). The times are summed over threads
+def total_counters(sims: Iterable[MonteCarlo])->dict:...
+
+#throughput report of the update methods of a model, as a json string (use mcpy.benchmark or python -m mcpy.bench).
+#model: "ising2d", "packed", "ising3d", "potts3" or "xy2d". methods=None runs all methods of the model.
+#threads=1 times a single chain, threads=n>1 times n simulations through update_all.
+def _benchmark(model: str, methods: list[str]|None, L: Iterable[int], T: Iterable[float], threads: Iterable[int], min_time: float, seed: int)->str:...
+
+#memory-mapped, read-only (N, *state_shape) array of a trajectory file (see MonteCarlo.trajectory_file). The file is never modified, and it may still be written by a running simulation
+def read_trajectory(path: str)->np.ndarray:...
+
+#perform many Monte Carlo simulations in parallel.
+#Each simulation is split in chunks of "chunk" steps (0: 16 chunks per simulation), and idle threads pick up
+#the next chunk of the simulation with the most remaining work, so batches of different sizes keep all threads busy.
+#progress(done_steps, total_steps) is called periodically, and returning False cancels the remaining chunks.
+def update_all(sims: Iterable[MonteCarlo], method: str, steps: int, sweeps=0, threads=-1, chunk=0, progress: Callable[[int, int], bool|None]|None = None)->None:...
+
+
+#same as update_all, but returns immediately
+def update_all_async(sims: Iterable[MonteCarlo], method: str, steps: int, sweeps=0, threads=-1, chunk=0)->AsyncJob:...
\ No newline at end of file
@@ -11,16 +11,66 @@ std::vector<double> to_vector(const py::iterable &iterable){
     return res;
 }
 
-py::list to_pystates(const std::vector<const State*>& states){
+std::vector<double> to_series(py::handle x){
+    py::array_t<double, py::array::c_style | py::array::forcecast> a = py::array_t<double, py::array::c_style | py::array::forcecast>::ensure(x);
+    if (!a || a.ndim() != 1){
+        throw std::runtime_error("A series needs to be a one-dimensional array of numbers");
+    }
+    return std::vector<double>(a.data(), a.data()+a.size());
+}
+
+Derived to_derived(py::function f){
+    return [f](const std::vector<double>& means){
+        return f(np_array<double>(means)).cast<double>();
+    };
+}
+
+py::list to_pystates(std::vector<std::unique_ptr<State>> states){
     py::list res(states.size());
     for (size_t i=0; i<states.size(); i++){
-        res[i] = states[i]->safe_clone();
+        res[i] = py::cast(std::move(states[i]));
+    }
+    return res;
+}
+
+py::array trajectory_array(const Trajectory& trajectory){
+    _Shape shape = {trajectory.N()};
+    shape.insert(shape.end(), trajectory.shape().begin(), trajectory.shape().end());
+    _Shape strides(shape.size());
+    size_t stride = trajectory.itemsize();
+    for (size_t i=shape.size(); i-- > 0;){
+        strides[i] = stride;
+        stride *= shape[i];
     }
+    //the array keeps the buffer alive even if the trajectory moves to a new buffer or is destroyed
+    py::capsule owner(new std::shared_ptr<const char[]>(trajectory.buffer()), [](void* p){
+        delete static_cast<std::shared_ptr<const char[]>*>(p);
+    });
+    py::array res(py::dtype(std::string(1, trajectory.format())), shape, strides, trajectory.data(), owner);
+    res.attr("setflags")(py::arg("write")=false);
     return res;
 }
 
+py::array spins_array(const SpinState& state, py::handle base){
+    py::array_t<int> res({state.shape[0], state.shape[1]}, {state.shape[1]*sizeof(int), sizeof(int)}, state.spins.data(), base);
+    res.attr("setflags")(py::arg("write")=false);
+    return res;
+}
+
+py::array chain_spins_array(const MarkovChain& chain){
+    //the array shares ownership of the state object, so it stays valid even if the chain drops the state (e.g. when a checkpoint of another size is loaded)
+    std::shared_ptr<const State> state = chain.shared_state();
+    const SpinState& spins = static_cast<const SpinState&>(*state);
+    py::capsule owner(new std::shared_ptr<const State>(std::move(state)), [](void* p){
+        delete static_cast<std::shared_ptr<const State>*>(p);
+    });
+    return spins_array(spins, owner);
+}
+
 Observable to_observable(py::object f){
     return [f](const State& state){
+        //simulations run without the GIL
+        py::gil_scoped_acquire acquire;
         return f(&state).cast<double>();
     };
 }
@@ -37,12 +87,94 @@ inline PyBinnedSample PySample::pybin_it() const{
     return this->bin_it();
 }
 
-void py_update_all(py::iterable obj, py::str method, const size_t& steps, const size_t& sweeps, const int& threads){
+ProgressCallback to_progress(py::object f){
+    if (f.is_none()){
+        return nullptr;
+    }
+    return [f](const size_t& done, const size_t& total){
+        py::gil_scoped_acquire acquire;
+        py::object res = f(done, total);
+        return res.is_none() || res.cast<bool>();
+    };
+}
+
+std::vector<MonteCarlo*> to_simulations(const py::iterable& obj){
     std::vector<MonteCarlo*> array;
     for (const py::handle& item : obj){
         array.push_back(&item.cast<MonteCarlo&>());
     }
-    update_all(array, method.cast<std::string>(), steps, sweeps, threads);
+    return array;
+}
+
+py::array_t<double> histogram_bins(const std::vector<JointHistogram::Bin>& bins){
+    std::vector<double> res(3*bins.size());
+    for (size_t i=0; i<bins.size(); i++){
+        res[3*i] = bins[i].E;
+        res[3*i+1] = bins[i].M;
+        res[3*i+2] = double(bins[i].count);
+    }
+    return np_array<double>(res, {bins.size(), 3});
+}
+
+py::dict reweighted_dict(const ReweightedPoint& p){
+    py::dict res;
+    res["T"] = p.T;
+    res["energy"] = p.energy;
+    res["specific_heat"] = p.specific_heat;
+    res["abs_M"] = p.abs_M;
+    res["M2"] = p.M2;
+    res["susceptibility"] = p.susceptibility;
+    res["binder_cumulant"] = p.binder_cumulant;
+    res["log_Z"] = p.log_Z;
+    return res;
+}
+
+py::dict reweighted_dict(const std::vector<ReweightedPoint>& p){
+    //one array per quantity, over all temperatures
+    const std::vector<std::pair<const char*, double ReweightedPoint::*>> fields = {
+        {"T", &ReweightedPoint::T}, {"energy", &ReweightedPoint::energy}, {"specific_heat", &ReweightedPoint::specific_heat},
+        {"abs_M", &ReweightedPoint::abs_M}, {"M2", &ReweightedPoint::M2}, {"susceptibility", &ReweightedPoint::susceptibility},
+        {"binder_cumulant", &ReweightedPoint::binder_cumulant}, {"log_Z", &ReweightedPoint::log_Z}};
+    py::dict res;
+    std::vector<double> x(p.size());
+    for (const auto& [name, field] : fields){
+        for (size_t i=0; i<p.size(); i++){
+            x[i] = p[i].*field;
+        }
+        res[name] = np_array<double>(x);
+    }
+    return res;
+}
+
+py::dict counters_dict(const ChainCounters& c){
+    //the cluster size histogram is cut after its last non-empty bin
+    size_t bins = c.cluster_sizes.size();
+    while (bins > 0 && c.cluster_sizes[bins-1] == 0){
+        bins--;
+    }
+    py::list hist;
+    for (size_t k=0; k<bins; k++){
+        hist.append(c.cluster_sizes[k]);
+    }
+    py::dict res;
+    res["proposals"] = c.proposals;
+    res["accepted"] = c.accepted;
+    res["acceptance"] = c.acceptance();
+    res["clusters"] = c.clusters;
+    res["mean_cluster_size"] = c.mean_cluster_size();
+    res["cluster_sizes"] = hist;
+    res["update_seconds"] = c.update_seconds;
+    res["measure_seconds"] = c.measure_seconds;
+    res["store_seconds"] = c.store_seconds;
+    return res;
+}
+
+void py_update_all(py::iterable obj, py::str method, const size_t& steps, const size_t& sweeps, const int& threads, const size_t& chunk, py::object progress){
+    std::vector<MonteCarlo*> array = to_simulations(obj);
+    std::string name = method.cast<std::string>();
+    ProgressCallback callback = to_progress(progress);
+    py::gil_scoped_release release;
+    update_all(array, name, steps, sweeps, threads, chunk, callback);
 }
 
 
@@ -68,10 +200,117 @@ void define_base_module(py::module &m)
         .def_property_readonly("binned_samples", [](const PyBinnedSample& self){return to_pysamples(self.samples());});
 
 
+    py::class_<Accumulator>(m, "Accumulator", py::module_local())
+        .def_property_readonly("N", &Accumulator::N)
+        .def("mean", &Accumulator::mean)
+        .def("std", &Accumulator::std)
+        .def("popul_std", &Accumulator::popul_std)
+        .def("error", &Accumulator::error)
+        .def("merge", [](Accumulator& self, const Accumulator& other){ self += other;}, py::arg("other"))
+        .def_property_readonly("stat", &Accumulator::message);
+
+    py::class_<BinningAccumulator>(m, "BinningAccumulator", py::module_local())
+        .def(py::init<size_t>(), py::arg("min_bins")=64)
+        .def("add", &BinningAccumulator::add, py::arg("x"))
+        .def_property_readonly("N", &BinningAccumulator::N)
+        .def("mean", &BinningAccumulator::mean)
+        .def("std", &BinningAccumulator::std)
+        .def("error", &BinningAccumulator::error, py::arg("level")=0)
+        .def("binned_error", &BinningAccumulator::binned_error)
+        .def_property_readonly("max_level", &BinningAccumulator::max_level)
+        .def_property_readonly("converged", &BinningAccumulator::converged)
+        .def_property_readonly("tau_estimate", &BinningAccumulator::tau_estimate)
+        .def_property_readonly("levels", [](const BinningAccumulator& self){
+            py::list res;
+            for (const Accumulator& acc : self.levels()){
+                res.append(acc);
+            }
+            return res;
+        })
+        .def("reset", &BinningAccumulator::reset);
+
+    py::class_<ResampleResult>(m, "ResampleResult", py::module_local())
+        .def_readonly("estimate", &ResampleResult::estimate)
+        .def_readonly("value", &ResampleResult::value)
+        .def_readonly("bias", &ResampleResult::bias)
+        .def_readonly("error", &ResampleResult::error)
+        .def_property_readonly("stat", &ResampleResult::message);
+
+    py::class_<Resampler>(m, "Resampler", py::module_local())
+        .def(py::init([](py::iterable series, const size_t& bin_size){
+            std::vector<std::vector<double>> x;
+            for (py::handle s : series){
+                x.push_back(to_series(s));
+            }
+            return Resampler(x, bin_size);
+        }), py::arg("series"), py::arg("bin_size")=1)
+        .def_property_readonly("series", &Resampler::series)
+        .def_property_readonly("blocks", &Resampler::blocks)
+        .def_property_readonly("means", [](const Resampler& self){return np_array<double>(self.means());})
+        //python functions hold the GIL, so they are evaluated in a single thread
+        .def("jackknife", [](const Resampler& self, py::function f){
+            return self.jackknife(to_derived(f), 1);
+        }, py::arg("f"))
+        .def("bootstrap", [](const Resampler& self, py::function f, const size_t& resamples, const uint64_t& seed){
+            return self.bootstrap(to_derived(f), resamples, seed, 1);
+        }, py::arg("f"), py::arg("resamples")=1000, py::arg("seed")=0);
+
+    m.def("thermodynamics", [](py::object E, py::object M, const double& T, const size_t& N, const size_t& bin_size, const size_t& bootstrap, const uint64_t& seed){
+        const std::vector<double> e = to_series(E), mag = to_series(M);
+        std::vector<ResampleResult> res;
+        {
+            py::gil_scoped_release release;
+            const Resampler r = thermo_resampler(e, mag, bin_size);
+            const std::vector<Derived> f = {specific_heat(T, N), susceptibility(T, N), binder_cumulant()};
+            res = (bootstrap > 0) ? r.bootstrap(f, bootstrap, seed) : r.jackknife(f);
+        }
+        py::dict out;
+        out["specific_heat"] = res[0];
+        out["susceptibility"] = res[1];
+        out["binder_cumulant"] = res[2];
+        return out;
+    }, py::arg("E"), py::arg("M"), py::arg("T"), py::arg("N"), py::arg("bin_size")=1, py::arg("bootstrap")=0, py::arg("seed")=0);
+
+    py::class_<JointHistogram>(m, "JointHistogram", py::module_local())
+        .def(py::init<double, double, double>(), py::arg("T")=1, py::arg("dE")=1, py::arg("dM")=1)
+        .def("add", &JointHistogram::add, py::arg("E"), py::arg("M"))
+        .def("merge", [](JointHistogram& self, const JointHistogram& other){self += other;}, py::arg("other"))
+        .def_property_readonly("T", &JointHistogram::T)
+        .def_property_readonly("dE", &JointHistogram::dE)
+        .def_property_readonly("dM", &JointHistogram::dM)
+        .def_property_readonly("N", &JointHistogram::N)
+        .def_property_readonly("size", &JointHistogram::size)
+        .def_property_readonly("bins", [](const JointHistogram& self){return histogram_bins(self.bins());})
+        .def("reset", &JointHistogram::reset);
+
+    py::class_<Reweighting>(m, "Reweighting", py::module_local())
+        .def(py::init([](py::iterable histograms, const size_t& N, const double& tol, const size_t& max_iter){
+            std::vector<JointHistogram> h;
+            for (py::handle item : histograms){
+                h.push_back(item.cast<const JointHistogram&>());
+            }
+            py::gil_scoped_release release;
+            return Reweighting(h, N, tol, max_iter);
+        }), py::arg("histograms"), py::arg("N"), py::arg("tol")=1e-10, py::arg("max_iter")=100000)
+        .def("at", [](const Reweighting& self, const double& T){return reweighted_dict(self.at(T));}, py::arg("T"))
+        .def("curve", [](const Reweighting& self, py::iterable T){
+            const std::vector<double> temps = to_vector(T);
+            std::vector<ReweightedPoint> res;
+            {
+                py::gil_scoped_release release;
+                res = self.curve(temps);
+            }
+            return reweighted_dict(res);
+        }, py::arg("T"))
+        .def_property_readonly("free_energies", [](const Reweighting& self){return np_array<double>(self.free_energies());})
+        .def_property_readonly("iterations", &Reweighting::iterations)
+        .def_property_readonly("log_g", [](const Reweighting& self){return np_array<double>(self.log_g());})
+        .def_property_readonly("bins", [](const Reweighting& self){return histogram_bins(self.bins());});
+
     py::class_<State, std::unique_ptr<State>>(m, "State", py::module_local());
 
     py::class_<SpinState, State>(m, "SpinState", py::module_local())
-        .def_property_readonly("spins", [](const SpinState& self){return np_array<int>(self.spins, {self.shape[0], self.shape[1]});})
+        .def_property_readonly("spins", [](py::object self){return spins_array(self.cast<const SpinState&>(), self);})
         .def("__call__", [](const SpinState& self, long int i) {
             return self(i);
         })
@@ -80,35 +319,316 @@ void define_base_module(py::module &m)
         })
         .def_property_readonly("sites", &SpinState::sites)
         .def_property_readonly("M", &SpinState::M)
-        .def_property_readonly("energy", &SpinState::energy);
+        .def_property_readonly("energy", &SpinState::energy)
+        .def("structure_factor", &SpinState::structure_factor, py::arg("nx"), py::arg("ny"));
+
+    py::class_<PackedSpinState, State>(m, "PackedSpinState", py::module_local())
+        .def(py::init<const SpinState&>(), py::arg("state"))
+        .def_property_readonly("spins", [](const PackedSpinState& self){return np_array<int>(self.unpack().spins, {self.shape[0], self.shape[1]});})
+        .def("__call__", [](const PackedSpinState& self, long int i, long int j) {
+            return self(i, j);
+        })
+        .def("unpack", &PackedSpinState::unpack)
+        .def_property_readonly("sites", &PackedSpinState::sites)
+        .def_property_readonly("M", &PackedSpinState::M)
+        .def_property_readonly("energy", &PackedSpinState::energy)
+        .def("structure_factor", &PackedSpinState::structure_factor, py::arg("nx"), py::arg("ny"));
 
     py::class_<MarkovChain, std::unique_ptr<MarkovChain>>(m, "MarkovChain", py::module_local())
         .def_property_readonly("state", [](const MarkovChain& self) {return self.state().safe_clone();})
-        .def("update", [](MarkovChain& self, py::str method, const size_t& steps) {return self.update(method.cast<std::string>(), steps);}, py::arg("method"), py::arg("steps")=1);
+        .def("update", [](MarkovChain& self, const std::string& method, const size_t& steps) {return self.update(method, steps);}, py::arg("method"), py::arg("steps")=1, py::call_guard<py::gil_scoped_release>())
+        .def("seed", &MarkovChain::seed, py::arg("seed"), py::arg("stream")=0)
+        .def_property_readonly("seed_value", [](const MarkovChain& self){return self.rng().seed();})
+        .def_property_readonly("stream", [](const MarkovChain& self){return self.rng().stream();})
+        .def_property("counting", &MarkovChain::counting, &MarkovChain::set_counting)
+        .def_property_readonly("counters", [](const MarkovChain& self){return counters_dict(self.counters());})
+        .def("reset_counters", &MarkovChain::reset_counters);
 
 
     py::class_<IsingModel2DMarkovChain, MarkovChain>(m, "IsingModel2DMarkovChain", py::module_local())
-        .def(py::init<double, size_t, size_t>(), py::arg("T"), py::arg("Lx"), py::arg("Ly"))
+        .def(py::init<double, size_t, size_t, double, double, double>(), py::arg("T"), py::arg("Lx"), py::arg("Ly"), py::arg("Jx")=1, py::arg("Jy")=1, py::arg("h")=0)
+        .def_property_readonly("Jx", &IsingModel2DMarkovChain::Jx)
+        .def_property_readonly("Jy", &IsingModel2DMarkovChain::Jy)
+        .def_property("h", &IsingModel2DMarkovChain::h, &IsingModel2DMarkovChain::set_field)
+        .def("set_couplings", &IsingModel2DMarkovChain::set_couplings, py::arg("Jx"), py::arg("Jy"))
         .def("ssf_update", &IsingModel2DMarkovChain::ssf_update)
-        .def("wolff_update", &IsingModel2DMarkovChain::wolff_update);
+        .def("wolff_update", &IsingModel2DMarkovChain::wolff_update)
+        .def("sw_update", &IsingModel2DMarkovChain::sw_update)
+        .def("checkerboard_update", &IsingModel2DMarkovChain::checkerboard_update)
+        .def("parallel_checkerboard_update", &IsingModel2DMarkovChain::parallel_checkerboard_update)
+        .def_property("threads", &IsingModel2DMarkovChain::threads, &IsingModel2DMarkovChain::set_threads)
+        .def_property_readonly("spins", [](const IsingModel2DMarkovChain& self){return chain_spins_array(self);})
+        .def_property_readonly("energy", &IsingModel2DMarkovChain::energy)
+        .def_property_readonly("M", &IsingModel2DMarkovChain::magnetization);
+
+    py::class_<PackedIsingModel2DMarkovChain, MarkovChain>(m, "PackedIsingModel2DMarkovChain", py::module_local())
+        .def(py::init<double, size_t, size_t>(), py::arg("T"), py::arg("Lx"), py::arg("Ly"))
+        .def("msc_update", &PackedIsingModel2DMarkovChain::msc_update)
+        .def_property_readonly("energy", &PackedIsingModel2DMarkovChain::energy)
+        .def_property_readonly("M", &PackedIsingModel2DMarkovChain::magnetization);
 
     py::class_<MonteCarlo, std::unique_ptr<MonteCarlo>>(m, "MonteCarlo", py::module_local())
         .def(py::init<MarkovChain&>(), py::arg("markov_chain"))
         .def_property_readonly("data", [](MonteCarlo& self){return to_pystates(self.data());})
+        .def_property_readonly("trajectory", [](const MonteCarlo& self){return trajectory_array(self.trajectory());})
         .def_property_readonly("N", &MonteCarlo::N)
-        .def("sample", [](const MonteCarlo& self, py::object obs){return PySample(self.sample(to_observable(obs)));}, py::arg("observable"))
-        .def("update", &MonteCarlo::update, py::arg("method"), py::arg("steps"), py::arg("sweeps")=0)
-        .def("thermalize", &MonteCarlo::thermalize, py::arg("method"), py::arg("sweeps"));
+        .def("sample", [](const MonteCarlo& self, py::object obs, const int& threads){
+            if (py::isinstance<py::str>(obs)){
+                //built-in observables are evaluated natively, in parallel
+                const std::string name = obs.cast<std::string>();
+                py::gil_scoped_release release;
+                return PySample(self.sample(name, threads));
+            }
+            return PySample(self.sample(to_observable(obs)));
+        }, py::arg("observable"), py::arg("threads")=-1)
+        .def("batch_sample", [](py::object self, py::object obs){
+            //obs receives all stored states at once, as a view of shape (N, *state_shape)
+            return PySample(self.cast<const MonteCarlo&>().batch_sample([&](const Trajectory& trajectory){
+                py::array_t<double, py::array::c_style | py::array::forcecast> res = obs(trajectory_array(trajectory));
+                return std::vector<double>(res.data(), res.data()+res.size());
+            }));
+        }, py::arg("observable"))
+        .def("update", &MonteCarlo::update, py::arg("method"), py::arg("steps"), py::arg("sweeps")=0, py::call_guard<py::gil_scoped_release>())
+        .def("seed", &MonteCarlo::seed, py::arg("seed"), py::arg("stream")=0)
+        .def_property("counting", [](const MonteCarlo& self){return self.chain().counting();}, &MonteCarlo::set_counting)
+        .def_property_readonly("counters", [](const MonteCarlo& self){return counters_dict(self.counters());})
+        .def("reset_counters", &MonteCarlo::reset_counters)
+        .def("record_histogram", &MonteCarlo::record_histogram, py::arg("T"), py::arg("dE")=1, py::arg("dM")=1)
+        .def("stop_histogram", &MonteCarlo::stop_histogram)
+        .def_property_readonly("recording_histogram", &MonteCarlo::recording_histogram)
+        .def_property_readonly("histogram", [](const MonteCarlo& self){return self.histogram();})
+        .def("thermalize", &MonteCarlo::thermalize, py::arg("method"), py::arg("sweeps"), py::call_guard<py::gil_scoped_release>())
+        .def("update_adaptive", [](MonteCarlo& self, const std::string& method, py::dict errors, const size_t& max_steps, const size_t& calibration, const size_t& max_sweeps){
+            std::vector<ErrorTarget> targets;
+            for (const auto& [name, error] : errors){
+                targets.push_back({name.cast<std::string>(), error.cast<double>()});
+            }
+            AdaptiveSchedule res;
+            {
+                py::gil_scoped_release release;
+                res = self.update_adaptive(method, targets, max_steps, calibration, max_sweeps);
+            }
+            py::dict tau, error;
+            for (size_t k=0; k<targets.size(); k++){
+                tau[py::str(targets[k].observable)] = res.tau[k];
+                error[py::str(targets[k].observable)] = res.error[k];
+            }
+            py::dict out;
+            out["sweeps"] = res.sweeps;
+            out["steps"] = res.steps;
+            out["calibration_updates"] = res.calibration_updates;
+            out["tau"] = tau;
+            out["error"] = error;
+            out["reached"] = res.reached;
+            return out;
+        }, py::arg("method"), py::arg("errors"), py::arg("max_steps"), py::arg("calibration")=1024, py::arg("max_sweeps")=10000)
+        .def("update_async", [](py::object self, const std::string& method, const size_t& steps, const size_t& sweeps, const size_t& chunk){
+            MonteCarlo* sim = &self.cast<MonteCarlo&>();
+            return std::make_unique<PyAsyncJob>([=](const ProgressCallback& progress, std::atomic<bool>* cancel){
+                update_all({sim}, method, steps, sweeps, 1, chunk, progress, cancel);
+            }, self);
+        }, py::arg("method"), py::arg("steps"), py::arg("sweeps")=0, py::arg("chunk")=0)
+        .def("thermalize_async", [](py::object self, const std::string& method, const size_t& sweeps, const size_t& chunk){
+            MonteCarlo* sim = &self.cast<MonteCarlo&>();
+            return std::make_unique<PyAsyncJob>([=](const ProgressCallback& progress, std::atomic<bool>* cancel){
+                const size_t chunk_sweeps = (chunk > 0) ? chunk : std::max<size_t>(1, (sweeps+15)/16);
+                for (size_t done=0; done<sweeps && !cancel->load(); done+=chunk_sweeps){
+                    sim->thermalize(method, std::min(chunk_sweeps, sweeps-done));
+                    progress(std::min(done+chunk_sweeps, sweeps), sweeps);
+                }
+            }, self);
+        }, py::arg("method"), py::arg("sweeps"), py::arg("chunk")=0)
+        .def("add_observable", [](MonteCarlo& self, const std::string& name, py::object obs){
+            if (obs.is_none()){
+                self.add_observable(name);
+            }
+            else{
+                self.add_observable(name, to_observable(obs));
+            }
+        }, py::arg("name"), py::arg("observable")=py::none())
+        .def("observable", [](const MonteCarlo& self, const std::string& name){return self.observable(name);}, py::arg("name"))
+        .def_property_readonly("observables", [](const MonteCarlo& self){
+            py::list res;
+            for (const std::string& name : self.observables()){
+                res.append(name);
+            }
+            return res;
+        })
+        .def("reset_observables", &MonteCarlo::reset_observables)
+        .def_property("store_states", &MonteCarlo::store_states, &MonteCarlo::set_store_states)
+        .def("save", py::overload_cast<const std::string&, const bool&>(&MonteCarlo::save, py::const_), py::arg("path"), py::arg("trajectory")=true, py::call_guard<py::gil_scoped_release>())
+        .def("load", py::overload_cast<const std::string&>(&MonteCarlo::load), py::arg("path"), py::call_guard<py::gil_scoped_release>())
+        .def_property("trajectory_file", &MonteCarlo::trajectory_file, &MonteCarlo::set_trajectory_file);
     
     py::class_<IsingModel2D, MonteCarlo>(m, "IsingModel2D", py::module_local())
+        .def(py::init<double, size_t, size_t, double, double, double>(), py::arg("T"), py::arg("Lx"), py::arg("Ly"), py::arg("Jx")=1, py::arg("Jy")=1, py::arg("h")=0)
+        .def_property("Temp", &IsingModel2D::T, &IsingModel2D::set_T)
+        .def_property_readonly("Jx", [](const IsingModel2D& self){return self.chain().Jx();})
+        .def_property_readonly("Jy", [](const IsingModel2D& self){return self.chain().Jy();})
+        .def_property("h", [](const IsingModel2D& self){return self.chain().h();}, &IsingModel2D::set_field)
+        .def("set_couplings", &IsingModel2D::set_couplings, py::arg("Jx"), py::arg("Jy"))
+        .def_property_readonly("spins", [](const IsingModel2D& self){return chain_spins_array(self.chain());})
+        .def_property_readonly("energy", [](const IsingModel2D& self){return self.chain().energy();})
+        .def_property_readonly("M", [](const IsingModel2D& self){return self.chain().magnetization();})
+        .def("exchange_chain", &IsingModel2D::exchange_chain, py::arg("other"))
+        .def("ssf_update", &IsingModel2D::ssf_update, py::arg("steps"), py::arg("sweeps")=0, py::call_guard<py::gil_scoped_release>())
+        .def("wolff_update", &IsingModel2D::wolff_update, py::arg("steps"), py::arg("sweeps")=0, py::call_guard<py::gil_scoped_release>())
+        .def("ssf_thermalize", &IsingModel2D::ssf_thermalize, py::arg("sweeps"), py::call_guard<py::gil_scoped_release>())
+        .def("wolff_thermalize", &IsingModel2D::wolff_thermalize, py::arg("sweeps"), py::call_guard<py::gil_scoped_release>())
+        .def("sw_update", &IsingModel2D::sw_update, py::arg("steps"), py::arg("sweeps")=0, py::call_guard<py::gil_scoped_release>())
+        .def("sw_thermalize", &IsingModel2D::sw_thermalize, py::arg("sweeps"), py::call_guard<py::gil_scoped_release>())
+        .def("checkerboard_update", &IsingModel2D::checkerboard_update, py::arg("steps"), py::arg("sweeps")=0, py::call_guard<py::gil_scoped_release>())
+        .def("checkerboard_thermalize", &IsingModel2D::checkerboard_thermalize, py::arg("sweeps"), py::call_guard<py::gil_scoped_release>())
+        .def("parallel_checkerboard_update", &IsingModel2D::parallel_checkerboard_update, py::arg("steps"), py::arg("sweeps")=0, py::call_guard<py::gil_scoped_release>())
+        .def("parallel_checkerboard_thermalize", &IsingModel2D::parallel_checkerboard_thermalize, py::arg("sweeps"), py::call_guard<py::gil_scoped_release>())
+        .def_property("threads", [](const IsingModel2D& self){return self.chain().threads();}, &IsingModel2D::set_threads)
+        .def("energy_sample", [](const IsingModel2D& self){return PySample(self.energy_sample());}, py::call_guard<py::gil_scoped_release>())
+        .def("structure_factor_sample", [](const IsingModel2D& self, const size_t& nx, const size_t& ny){return PySample(self.structure_factor_sample(nx, ny));}, py::arg("nx"), py::arg("ny"), py::call_guard<py::gil_scoped_release>())
+        .def(py::pickle(
+            [](const IsingModel2D& self){return checkpoint_bytes(self);},
+            [](const py::bytes& data){return from_checkpoint_bytes(IsingModel2D(1, 2, 2), data);}
+        ));
+
+    py::class_<PackedIsingModel2D, MonteCarlo>(m, "PackedIsingModel2D", py::module_local())
         .def(py::init<double, size_t, size_t>(), py::arg("T"), py::arg("Lx"), py::arg("Ly"))
-        .def_property_readonly("Temp", &IsingModel2D::T)
-        .def("ssf_update", &IsingModel2D::ssf_update, py::arg("steps"), py::arg("sweeps")=0)
-        .def("wolff_update", &IsingModel2D::wolff_update, py::arg("steps"), py::arg("sweeps")=0)
-        .def("ssf_thermalize", &IsingModel2D::ssf_thermalize, py::arg("sweeps"))
-        .def("wolff_thermalize", &IsingModel2D::wolff_thermalize, py::arg("sweeps"))
-        .def("energy_sample", [](const IsingModel2D& self){return PySample(self.energy_sample());});
-
-    m.def("update_all", py_update_all, py::arg("sims"), py::arg("method"), py::arg("steps"), py::arg("sweeps")=0, py::arg("threads")=-1);
+        .def_property_readonly("Temp", &PackedIsingModel2D::T)
+        .def_property_readonly("energy", [](const PackedIsingModel2D& self){return self.chain().energy();})
+        .def_property_readonly("M", [](const PackedIsingModel2D& self){return self.chain().magnetization();})
+        .def("msc_update", &PackedIsingModel2D::msc_update, py::arg("steps"), py::arg("sweeps")=0, py::call_guard<py::gil_scoped_release>())
+        .def("msc_thermalize", &PackedIsingModel2D::msc_thermalize, py::arg("sweeps"), py::call_guard<py::gil_scoped_release>())
+        .def("energy_sample", [](const PackedIsingModel2D& self){return PySample(self.energy_sample());}, py::call_guard<py::gil_scoped_release>())
+        .def(py::pickle(
+            [](const PackedIsingModel2D& self){return checkpoint_bytes(self);},
+            [](const py::bytes& data){return from_checkpoint_bytes(PackedIsingModel2D(1, 64, 2), data);}
+        ));
+
+    define_lattice_model<Ising3D>(m, "Ising3D");
+
+    define_lattice_model<IsingTriangular>(m, "IsingTriangular");
+
+    define_lattice_model<Potts2D<3>>(m, "Potts3");
+
+    define_lattice_model<Potts2D<4>>(m, "Potts4");
+
+    define_lattice_model<XY2D>(m, "XY2D");
+
+    py::class_<ParallelTempering>(m, "ParallelTempering", py::module_local())
+        .def(py::init([](const py::iterable& temperatures, const size_t& Lx, const size_t& Ly){return ParallelTempering(to_vector(temperatures), Lx, Ly);}), py::arg("temperatures"), py::arg("Lx"), py::arg("Ly"))
+        .def_property_readonly("replicas", &ParallelTempering::replicas)
+        .def_property_readonly("temperatures", [](const ParallelTempering& self){return np_array<double>(self.temperatures());})
+        .def_property_readonly("acceptance_rates", [](const ParallelTempering& self){return np_array<double>(self.acceptance_rates());})
+        .def("sim", [](ParallelTempering& self, const size_t& k) -> IsingModel2D& {return self.sim(k);}, py::arg("k"), py::return_value_policy::reference_internal)
+        .def("add_observable", &ParallelTempering::add_observable, py::arg("name"))
+        .def("update", &ParallelTempering::update, py::arg("method"), py::arg("rounds"), py::arg("steps")=1, py::arg("sweeps")=0, py::arg("threads")=-1, py::call_guard<py::gil_scoped_release>())
+        .def("exchange", &ParallelTempering::exchange)
+        .def("tune", &ParallelTempering::tune)
+        .def("reset_rates", &ParallelTempering::reset_rates);
+
+    py::class_<DensityOfStates>(m, "DensityOfStates", py::module_local())
+        .def("at", [](const DensityOfStates& self, const double& T){return reweighted_dict(self.at(T));}, py::arg("T"))
+        .def("curve", [](const DensityOfStates& self, py::iterable T){
+            const std::vector<double> temps = to_vector(T);
+            std::vector<ReweightedPoint> res;
+            {
+                py::gil_scoped_release release;
+                res = self.curve(temps);
+            }
+            return reweighted_dict(res);
+        }, py::arg("T"))
+        .def_property_readonly("energies", [](const DensityOfStates& self){return np_array<double>(self.energies());})
+        .def_property_readonly("log_g", [](const DensityOfStates& self){return np_array<double>(self.log_g());})
+        .def_property_readonly("abs_M", [](const DensityOfStates& self){return np_array<double>(self.abs_M());})
+        .def_property_readonly("M2", [](const DensityOfStates& self){return np_array<double>(self.M2());})
+        .def_property_readonly("M4", [](const DensityOfStates& self){return np_array<double>(self.M4());})
+        .def_property_readonly("N", &DensityOfStates::N);
+
+    py::class_<WangLandau>(m, "WangLandau", py::module_local())
+        .def(py::init([](const size_t& Lx, const size_t& Ly, const size_t& windows, const double& overlap, py::object E_min, py::object E_max){
+            const long int N = Lx*Ly;
+            return WangLandau(Lx, Ly, E_min.is_none() ? -2*N : E_min.cast<long int>(), E_max.is_none() ? 2*N : E_max.cast<long int>(), windows, overlap);
+        }), py::arg("Lx"), py::arg("Ly"), py::arg("windows")=1, py::arg("overlap")=0.5, py::arg("E_min")=py::none(), py::arg("E_max")=py::none())
+        .def_property_readonly("windows", &WangLandau::windows)
+        .def_property_readonly("sites", &WangLandau::sites)
+        .def_property_readonly("ranges", [](const WangLandau& self){
+            py::list res;
+            for (size_t k=0; k<self.windows(); k++){
+                res.append(py::make_tuple(self.window(k).E_min(), self.window(k).E_max()));
+            }
+            return res;
+        })
+        .def_property_readonly("ln_f", [](const WangLandau& self){
+            std::vector<double> res(self.windows());
+            for (size_t k=0; k<self.windows(); k++){
+                res[k] = self.window(k).ln_f();
+            }
+            return np_array<double>(res);
+        })
+        .def("run", &WangLandau::run, py::arg("flatness")=0.8, py::arg("final_ln_f")=1e-6, py::arg("check_sweeps")=100, py::arg("max_sweeps")=0, py::arg("threads")=-1, py::call_guard<py::gil_scoped_release>())
+        .def("production", &WangLandau::production, py::arg("sweeps"), py::arg("iterations")=1, py::arg("threads")=-1, py::call_guard<py::gil_scoped_release>())
+        .def("density_of_states", &WangLandau::density_of_states)
+        .def_property("counting", [](const WangLandau& self){return self.window(0).counting();}, &WangLandau::set_counting)
+        .def_property_readonly("counters", [](const WangLandau& self){return counters_dict(self.counters());});
+
+    py::class_<PyAsyncJob, std::unique_ptr<PyAsyncJob>>(m, "AsyncJob", py::module_local())
+        .def("done", &PyAsyncJob::done)
+        .def("wait", [](PyAsyncJob& self, py::object timeout){
+            const double t = timeout.is_none() ? -1 : timeout.cast<double>();
+            py::gil_scoped_release release;
+            return self.wait(t);
+        }, py::arg("timeout")=py::none())
+        .def("cancel", &PyAsyncJob::cancel)
+        .def("result", &PyAsyncJob::result, py::call_guard<py::gil_scoped_release>())
+        .def_property_readonly("cancelled", &PyAsyncJob::cancelled)
+        .def_property_readonly("progress", &PyAsyncJob::progress)
+        .def_property_readonly("steps_done", &PyAsyncJob::steps_done)
+        .def_property_readonly("total_steps", &PyAsyncJob::total_steps);
+
+    m.def("set_seed", &set_global_seed, py::arg("seed"));
+
+    m.def("read_trajectory", [](const std::string& path){
+        Trajectory trajectory;
+        trajectory.read_file(path);
+        return trajectory_array(trajectory);
+    }, py::arg("path"));
+
+    m.def("update_all", py_update_all, py::arg("sims"), py::arg("method"), py::arg("steps"), py::arg("sweeps")=0, py::arg("threads")=-1, py::arg("chunk")=0, py::arg("progress")=py::none());
+
+    m.def("update_all_async", [](py::iterable obj, const std::string& method, const size_t& steps, const size_t& sweeps, const int& threads, const size_t& chunk){
+        py::list sims(obj);
+        std::vector<MonteCarlo*> array = to_simulations(sims);
+        return std::make_unique<PyAsyncJob>([=](const ProgressCallback& progress, std::atomic<bool>* cancel){
+            update_all(array, method, steps, sweeps, threads, chunk, progress, cancel);
+        }, sims);
+    }, py::arg("sims"), py::arg("method"), py::arg("steps"), py::arg("sweeps")=0, py::arg("threads")=-1, py::arg("chunk")=0);
+
+    m.def("total_counters", [](py::iterable sims){return counters_dict(total_counters(to_simulations(sims)));}, py::arg("sims"));
+
+    //wrapped by mcpy.benchmark, which parses the json report
+    m.def("_benchmark", [](const std::string& model, py::object methods, py::iterable L, py::iterable T, py::iterable threads, const double& min_time, const uint64_t& seed){
+        BenchConfig config;
+        config.model = model;
+        config.min_time = min_time;
+        config.seed = seed;
+        config.methods.clear();
+        if (!methods.is_none()){
+            for (py::handle x : methods){
+                config.methods.push_back(x.cast<std::string>());
+            }
+        }
+        config.L.clear();
+        for (py::handle x : L){
+            config.L.push_back(x.cast<size_t>());
+        }
+        config.T.clear();
+        for (py::handle x : T){
+            config.T.push_back(x.cast<double>());
+        }
+        config.threads.clear();
+        for (py::handle x : threads){
+            config.threads.push_back(x.cast<int>());
+        }
+        py::gil_scoped_release release;
+        return to_json(run_benchmarks(config));
+    }, py::arg("model"), py::arg("methods"), py::arg("L"), py::arg("T"), py::arg("threads"), py::arg("min_time"), py::arg("seed"));
 }
 
@@ -1,9 +1,17 @@
 #ifndef MCPYEXT_BASE_HPP
 #define MCPYEXT_BASE_HPP
 
-#include "ising.hpp"
+#include "msc.hpp"
+#include "tempering.hpp"
+#include "lattice.hpp"
+#include "bench.hpp"
+#include "resampling.hpp"
+#include "reweighting.hpp"
+#include "wanglandau.hpp"
 #include <pybind11/pybind11.h>
 #include <pybind11/numpy.h>
+#include <sstream>
+#include <algorithm>
 
 namespace py = pybind11;
 
@@ -14,6 +22,8 @@ struct PySample;
 
 struct PyBinnedSample;
 
+struct PyAsyncJob;
+
 //----------------functions---------------------
 
 template<class T>
@@ -30,14 +40,75 @@ py::array_t<T> np_array(const std::vector<T>& x, const _Shape& shape={}){
 
 std::vector<double> to_vector(const py::iterable& iterable);
 
-py::list to_pystates(const std::vector<State>& states);
+std::vector<double> to_series(py::handle x); //copy of a one-dimensional array of numbers
+
+Derived to_derived(py::function f); //f receives the means as a numpy array. Must be called with the GIL held
+
+py::list to_pystates(std::vector<std::unique_ptr<State>> states);
+
+py::array trajectory_array(const Trajectory& trajectory); //read-only (N, *shape) view of the snapshots, that shares ownership of the trajectory buffer
+
+py::array spins_array(const SpinState& state, py::handle base); //read-only view of the spins of a state owned by base
+
+py::array chain_spins_array(const MarkovChain& chain); //live read-only view of the spins of an Ising chain, that shares ownership of its state object
 
 py::list to_pysamples(const std::vector<Sample>& states);
 
 Observable to_observable(py::object f);
 
+template<class Sim>
+py::bytes checkpoint_bytes(const Sim& sim){
+    std::ostringstream out;
+    sim.save(out);
+    return py::bytes(out.str());
+}
+
+template<class Sim>
+std::unique_ptr<Sim> from_checkpoint_bytes(const Sim& empty, const py::bytes& data){
+    //the lattice size and all parameters are taken from the checkpoint. The result is built in place and handed to pybind11 as its holder, so it is never moved
+    auto res = std::make_unique<Sim>(empty);
+    std::istringstream in(data.cast<std::string>());
+    res->load(in);
+    return res;
+}
+
 void define_base_module(py::module& m);
 
+template<class Sim>
+void define_lattice_model(py::module& m, const char* name){
+    //a LatticeModel instantiation. The shape is given as a sequence of Lattice::dim sizes
+    using Lattice = typename Sim::ChainType::StateType::lattice_type;
+    py::class_<Sim, MonteCarlo>(m, name, py::module_local())
+        .def(py::init([](const double& T, const py::iterable& shape){
+            std::vector<size_t> L; //integers, as the sizes of IsingModel2D: floats and negative sizes are a TypeError
+            for (const py::handle& item : shape){
+                L.push_back(item.cast<size_t>());
+            }
+            if (L.size() != Lattice::dim){
+                throw std::runtime_error("The lattice needs " + std::to_string(Lattice::dim) + " sizes");
+            }
+            else if (std::find(L.begin(), L.end(), size_t(0)) != L.end()){
+                throw std::runtime_error("The lattice sizes must be positive");
+            }
+            std::array<size_t, Lattice::dim> res;
+            std::copy(L.begin(), L.end(), res.begin());
+            return std::make_unique<Sim>(T, res);
+        }), py::arg("T"), py::arg("shape"))
+        .def_property("Temp", &Sim::T, &Sim::set_T)
+        .def_property_readonly("energy", [](const Sim& self){return self.chain().energy();})
+        .def_property_readonly("M", [](const Sim& self){return self.chain().magnetization();})
+        .def_property_readonly("spins", [](const Sim& self){
+            Trajectory current;
+            current.append(self.chain().state());
+            return trajectory_array(current)[py::int_(0)];
+        })
+        .def("ssf_update", &Sim::ssf_update, py::arg("steps"), py::arg("sweeps")=0, py::call_guard<py::gil_scoped_release>())
+        .def("ssf_thermalize", &Sim::ssf_thermalize, py::arg("sweeps"), py::call_guard<py::gil_scoped_release>())
+        .def("sweep_update", &Sim::sweep_update, py::arg("steps"), py::arg("sweeps")=0, py::call_guard<py::gil_scoped_release>())
+        .def("sweep_thermalize", &Sim::sweep_thermalize, py::arg("sweeps"), py::call_guard<py::gil_scoped_release>())
+        .def("energy_sample", [](const Sim& self){return PySample(self.energy_sample());}, py::call_guard<py::gil_scoped_release>());
+}
+
 
 struct PySample : public Sample{
 
@@ -57,6 +128,27 @@ struct PyBinnedSample : public BinningAnalysis{
     PyBinnedSample(const BinningAnalysis& obj) : BinningAnalysis(obj){}
 };
 
-void py_update_all(py::iterable obj, py::str method, const size_t& steps, const size_t& sweeps, const int& threads);
+ProgressCallback to_progress(py::object f);
+
+void py_update_all(py::iterable obj, py::str method, const size_t& steps, const size_t& sweeps, const int& threads, const size_t& chunk, py::object progress);
+
+std::vector<MonteCarlo*> to_simulations(const py::iterable& obj);
+
+
+struct PyAsyncJob : public AsyncJob{
+
+    //keeps the python objects that the work operates on alive until the job is destroyed
+
+    PyAsyncJob(const Work& work, py::object refs) : AsyncJob(work), refs(refs){}
+
+    ~PyAsyncJob(){
+        //the work might need the GIL to finish (e.g. python observables)
+        py::gil_scoped_release release;
+        this->cancel();
+        this->_join();
+    }
+
+    py::object refs;
+};
 
 #endif
\ No newline at end of file
@@ -0,0 +1,209 @@
+#include "msc.hpp"
+
+
+PackedSpinState::PackedSpinState(const SpinState& state):shape(state.shape){
+    if (shape[0] % 64 != 0 || shape[0] == 0){
+        throw std::runtime_error("PackedSpinState requires Lx to be a multiple of 64");
+    }
+    words = std::vector<uint64_t>(state.sites()/64, 0);
+    for (size_t k=0; k<state.sites(); k++){
+        if (state.spins[k] > 0){
+            words[k/64] |= uint64_t(1) << (k % 64);
+        }
+    }
+}
+
+int PackedSpinState::operator()(long int i, long int j) const{
+    i = (i + shape[0]) % shape[0];
+    j = (j + shape[1]) % shape[1];
+    const size_t k = j * shape[0] + i;
+    return ((words.at(k/64) >> (k % 64)) & 1) ? 1 : -1;
+}
+
+size_t PackedSpinState::sites() const{
+    return shape[0]*shape[1];
+}
+
+double PackedSpinState::M() const{
+    long int up = 0;
+    for (const uint64_t& w : words){
+        up += std::popcount(w);
+    }
+    return 2*up - long(this->sites());
+}
+
+double PackedSpinState::energy() const{
+    //every unsatisfied bond (antiparallel spins) costs +1, every satisfied one -1, and there are 2N bonds
+    const size_t W = row_words(), Ly = shape[1];
+    long int unsatisfied = 0;
+    for (size_t j=0; j<Ly; j++){
+        const uint64_t* row = words.data() + j*W;
+        const uint64_t* down = words.data() + ((j+1)%Ly)*W;
+        for (size_t w=0; w<W; w++){
+            const uint64_t right = (row[w] >> 1) | (row[(w+1)%W] << 63);
+            unsatisfied += std::popcount(row[w] ^ right) + std::popcount(row[w] ^ down[w]);
+        }
+    }
+    return 2*unsatisfied - 2*long(this->sites());
+}
+
+double PackedSpinState::structure_factor(const size_t& nx, const size_t& ny) const{
+    //read directly from the bits, without unpacking the lattice
+    const size_t Lx = shape[0];
+    const uint64_t* w = words.data();
+    return lattice_structure_factor(Lx, shape[1], nx, ny, [w, Lx](const size_t& i, const size_t& j){
+        const size_t k = j*Lx + i;
+        return ((w[k/64] >> (k % 64)) & 1) ? 1 : -1;
+    });
+}
+
+void PackedSpinState::snapshot(void* out) const{
+    int8_t* res = static_cast<int8_t*>(out);
+    for (size_t k=0; k<this->sites(); k++){
+        res[k] = ((words[k/64] >> (k % 64)) & 1) ? 1 : -1;
+    }
+}
+
+void PackedSpinState::load_snapshot(const void* in){
+    const int8_t* data = static_cast<const int8_t*>(in);
+    std::fill(words.begin(), words.end(), 0);
+    for (size_t k=0; k<this->sites(); k++){
+        if (data[k] > 0){
+            words[k/64] |= uint64_t(1) << (k % 64);
+        }
+    }
+}
+
+void PackedSpinState::save(BinaryWriter& out) const{
+    out.write(shape);
+    out.write_vector(words);
+}
+
+void PackedSpinState::load(BinaryReader& in){
+    const std::array<size_t, 2> new_shape = in.read<std::array<size_t, 2>>();
+    std::vector<uint64_t> new_words = in.read_vector<uint64_t>();
+    if (new_shape[0] % 64 != 0 || new_words.size() != new_shape[0]*new_shape[1]/64){
+        throw std::runtime_error("Corrupted packed spin state in checkpoint");
+    }
+    shape = new_shape;
+    words = std::move(new_words);
+}
+
+SpinState PackedSpinState::unpack() const{
+    std::vector<int> spins(this->sites());
+    for (size_t k=0; k<spins.size(); k++){
+        spins[k] = ((words[k/64] >> (k % 64)) & 1) ? 1 : -1;
+    }
+    return SpinState(spins, shape[0], shape[1]);
+}
+
+
+PackedIsingModel2DMarkovChain::PackedIsingModel2DMarkovChain(const double& T, const size_t& Lx, const size_t& Ly) : MarkovChain(PackedSpinState(SpinState(std::vector<int>(Lx*Ly, 1), Lx, Ly))), _T(T){
+    if (Ly % 2 != 0){
+        throw std::runtime_error("PackedIsingModel2DMarkovChain requires an even Ly");
+    }
+    static_cast<PackedSpinState&>(*this->_state) = PackedSpinState(SpinState(random_spins(Lx, Ly, this->_gen), Lx, Ly));
+    _set_threshold();
+    _E = this->packed_state().energy();
+    _M = this->packed_state().M();
+}
+
+void PackedIsingModel2DMarkovChain::save(BinaryWriter& out) const{
+    out.write_string("PackedIsingModel2DMarkovChain");
+    MarkovChain::save(out);
+    out.write(_T);
+}
+
+void PackedIsingModel2DMarkovChain::load(BinaryReader& in){
+    in.expect("PackedIsingModel2DMarkovChain");
+    MarkovChain::load(in);
+    _T = in.read<double>();
+    _set_threshold();
+    _E = this->packed_state().energy();
+    _M = this->packed_state().M();
+}
+
+void PackedIsingModel2DMarkovChain::_set_threshold(){
+    _threshold = uint32_t(std::min(std::exp(-4/_T) * 4294967296., 4294967295.));
+}
+
+uint64_t PackedIsingModel2DMarkovChain::_random_mask(){
+    //Each bit compares its own 32-bit random number (one bit taken from each random word) against the threshold,
+    //starting from the most significant bit. Most lanes are decided after a few words.
+    uint64_t less = 0, equal = ~uint64_t(0);
+    for (int k=31; k>=0 && equal; k--){
+        const uint64_t t = ((_threshold >> k) & 1) ? ~uint64_t(0) : 0;
+        const uint64_t r = _random_word();
+        less |= equal & ~r & t;
+        equal &= ~(r ^ t);
+    }
+    return less;
+}
+
+void PackedIsingModel2DMarkovChain::msc_update(){
+    PackedSpinState& S = static_cast<PackedSpinState&>(*this->_state);
+    const size_t W = S.row_words(), Ly = S.shape[1];
+    uint64_t* s = S.words.data();
+    long int flips = 0, unsatisfied = 0, up_flips = 0; //a flip with u unsatisfied bonds changes the energy by 8-4u
+    for (size_t color=0; color<2; color++){
+        for (size_t j=0; j<Ly; j++){
+            //sites with (i+j) % 2 == color. Each word starts at an even i
+            const uint64_t sublattice = ((j+color) % 2 == 0) ? 0x5555555555555555 : 0xAAAAAAAAAAAAAAAA;
+            uint64_t* row = s + j*W;
+            const uint64_t* up = s + ((j+Ly-1)%Ly)*W;
+            const uint64_t* down = s + ((j+1)%Ly)*W;
+            for (size_t w=0; w<W; w++){
+                const uint64_t x = row[w];
+                //1 where the bond to each neighbor is unsatisfied
+                const uint64_t a1 = x ^ ((x << 1) | (row[(w+W-1)%W] >> 63));
+                const uint64_t a2 = x ^ ((x >> 1) | (row[(w+1)%W] << 63));
+                const uint64_t a3 = x ^ up[w];
+                const uint64_t a4 = x ^ down[w];
+                //dE = 8 - 4*(unsatisfied bonds)
+                const uint64_t two_or_more = (a1 & a2) | (a3 & a4) | ((a1 ^ a2) & (a3 ^ a4));
+                const uint64_t none = ~(a1 | a2 | a3 | a4);
+                const uint64_t one = ~(two_or_more | none);
+
+                uint64_t flip = two_or_more;
+                if (sublattice & (one | none)){
+                    const uint64_t r = _random_mask();
+                    flip |= one & r;
+                    if (sublattice & none & r){
+                        flip |= none & r & _random_mask();
+                    }
+                }
+                flip &= sublattice;
+                row[w] = x ^ flip;
+                flips += std::popcount(flip);
+                up_flips += std::popcount(flip & x);
+                unsatisfied += std::popcount(flip & a1) + std::popcount(flip & a2) + std::popcount(flip & a3) + std::popcount(flip & a4);
+            }
+        }
+    }
+    _E += 8*flips - 4*unsatisfied;
+    _M += 2*(flips - up_flips) - 2*up_flips;
+    if (this->counting()){
+        _counters.proposals += S.shape[0]*Ly;
+        _counters.accepted += flips;
+    }
+}
+
+UpdateMethod PackedIsingModel2DMarkovChain::method(const std::string& name) const {
+    if (name == "msc"){
+        return static_method<PackedIsingModel2DMarkovChain, &PackedIsingModel2DMarkovChain::msc_update>();
+    }
+    else{
+        throw std::runtime_error("Unknown update method \"" + name + "\"");
+    }
+}
+
+
+ChainObservable PackedIsingModel2D::_builtin_chain_observable(const std::string& name) const{
+    ChainObservable res = chain_observable<PackedIsingModel2DMarkovChain>(name);
+    return res ? res : MonteCarlo::_builtin_chain_observable(name);
+}
+
+Observable PackedIsingModel2D::_builtin_observable(const std::string& name) const{
+    Observable res = spin_observable<PackedSpinState>(name);
+    return res ? res : MonteCarlo::_builtin_observable(name);
+}
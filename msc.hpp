@@ -0,0 +1,155 @@
+#ifndef MSC_HPP
+#define MSC_HPP
+
+#include "ising.hpp"
+#include <cstdint>
+#include <bit>
+
+struct PackedSpinState;
+
+class PackedIsingModel2DMarkovChain;
+
+class PackedIsingModel2D;
+
+
+struct PackedSpinState : public State{
+
+    /*
+    Periodic 2D spin lattice with one bit per spin (bit 1: spin +1, bit 0: spin -1).
+    Each row is stored in Lx/64 consecutive words, and bit b of word w in row j is the site (64*w+b, j).
+    Lx needs to be a multiple of 64.
+    */
+
+    std::vector<uint64_t> words;
+    std::array<size_t, 2> shape;
+
+    PackedSpinState(const SpinState& state);
+
+    State* clone() const override{
+        return new PackedSpinState(*this);
+    }
+
+    std::unique_ptr<State> safe_clone() const override{
+        return std::make_unique<PackedSpinState>(*this);
+    }
+
+    std::vector<size_t> snapshot_shape() const override{ return {shape[0], shape[1]};}
+
+    void snapshot(void* out) const override; //unpacked spins +1/-1, same as SpinState
+
+    void load_snapshot(const void* in) override;
+
+    void save(BinaryWriter& out) const override;
+
+    void load(BinaryReader& in) override; //takes the shape of the saved state
+
+    int operator()(long int i, long int j) const;
+
+    inline size_t row_words() const{ return shape[0]/64;}
+
+    size_t sites() const;
+
+    double M() const;
+
+    double energy() const;
+
+    double structure_factor(const size_t& nx, const size_t& ny) const;
+
+    SpinState unpack() const;
+
+};
+
+
+class PackedIsingModel2DMarkovChain : public MarkovChain{
+
+    /*
+    Multi-spin coding Ising chain. The Metropolis acceptance of all spins in a word
+    is evaluated at once with bitwise logic. Words are swept in checkerboard order,
+    so that only the bits of one sublattice are flipped at a time.
+    */
+
+public:
+
+    PackedIsingModel2DMarkovChain(const double& T, const size_t& Lx, const size_t& Ly);
+
+    const double& Temp() const{
+        return _T;
+    }
+
+    inline MarkovChain* clone() const override{ return new PackedIsingModel2DMarkovChain(*this);}
+
+    inline std::unique_ptr<MarkovChain> safe_clone() const override{ return std::make_unique<PackedIsingModel2DMarkovChain>(*this);}
+
+    UpdateMethod method(const std::string& name) const override;
+
+    void msc_update(); //one full lattice sweep
+
+    void save(BinaryWriter& out) const override;
+
+    void load(BinaryReader& in) override;
+
+    const PackedSpinState& packed_state() const{
+        return static_cast<const PackedSpinState&>(this->state());
+    }
+
+    inline size_t memory() const override{ return this->packed_state().words.capacity()*sizeof(uint64_t);}
+
+    inline double energy() const{ return _E;} //energy of the current state, kept up to date by msc_update
+
+    inline double magnetization() const{ return _M;}
+
+private:
+
+    double _T;
+    uint32_t _threshold; //exp(-4/T) in 32-bit fixed point. A flip that costs energy 8 needs two independent successes, since exp(-8/T) = exp(-4/T)^2
+    long int _E;
+    long int _M;
+
+    inline uint64_t _random_word(){ return this->_gen.next_u64();}
+
+    uint64_t _random_mask(); //every bit is set independently with probability exp(-4/T)
+
+    void _set_threshold();
+
+};
+
+
+class PackedIsingModel2D : public MonteCarlo{
+
+
+public:
+
+    PackedIsingModel2D(const double& T, const size_t& Lx, const size_t& Ly): MonteCarlo(PackedIsingModel2DMarkovChain(T, Lx, Ly)){}
+
+    void msc_update(const size_t& steps, const size_t& sweeps = 0){
+        this->update("msc", steps, sweeps);
+    }
+
+    void msc_thermalize(const size_t& sweeps){
+        this->thermalize("msc", sweeps);
+    }
+
+    inline Sample energy_sample() const{
+        return this->sample("energy");
+    }
+
+    inline double T() const{
+        return this->chain().Temp();
+    }
+
+    inline const PackedIsingModel2DMarkovChain& chain() const {
+        return static_cast<PackedIsingModel2DMarkovChain&>(*this->_mc);
+    }
+
+protected:
+
+    Observable _builtin_observable(const std::string& name) const override;
+
+    ChainObservable _builtin_chain_observable(const std::string& name) const override;
+
+    inline bool _chain_quantities() const override{ return true;}
+
+};
+
+
+#endif
@@ -0,0 +1,192 @@
+#include "resampling.hpp"
+#include <atomic>
+
+
+std::string ResampleResult::message() const{
+    return std::to_string(this->value) + " +/- " + std::to_string(this->error);
+}
+
+Resampler::Resampler(const std::vector<std::vector<double>>& series, const size_t& bin_size){
+    if (series.empty() || bin_size == 0){
+        throw std::runtime_error("A Resampler needs at least one series, and a positive bin size");
+    }
+    const size_t N = series[0].size();
+    for (const std::vector<double>& x : series){
+        if (x.size() != N){
+            throw std::runtime_error("All series of a Resampler need to have the same length");
+        }
+    }
+    _n = N/bin_size;
+    if (_n < 2 || _n > std::numeric_limits<uint32_t>::max()){
+        throw std::runtime_error("Resampling needs at least 2 blocks, and less than 2^32");
+    }
+    const size_t first = N - _n*bin_size;
+    _blocks.resize(series.size());
+    _sums.resize(series.size());
+    _means.resize(series.size());
+    for (size_t k=0; k<series.size(); k++){
+        _blocks[k].resize(_n);
+        #pragma omp parallel for schedule(static) if(N >= PARALLEL_STATS)
+        for (size_t b=0; b<_n; b++){
+            _blocks[k][b] = pairwise_sum(series[k].data() + first + b*bin_size, bin_size)/bin_size;
+        }
+        _sums[k] = sum(_blocks[k]);
+        _means[k] = _sums[k]/_n;
+    }
+}
+
+static std::vector<ResampleResult> collect(const std::vector<Derived>& f, const std::vector<double>& means, const std::vector<double>& theta, const size_t& samples, const bool& jackknife){
+    //theta[r*f.size() + i]: quantity i on resample r
+    std::vector<ResampleResult> res(f.size());
+    for (size_t i=0; i<f.size(); i++){
+        Moments m;
+        for (size_t r=0; r<samples; r++){
+            m.add(theta[r*f.size() + i]);
+        }
+        ResampleResult& out = res[i];
+        out.estimate = f[i](means);
+        if (jackknife){
+            out.bias = (samples-1)*(m.mean - out.estimate);
+            out.error = std::sqrt((samples-1)*m.var());
+        }
+        else{
+            out.bias = m.mean - out.estimate;
+            out.error = std::sqrt(m.m2/(samples-1));
+        }
+        out.value = out.estimate - out.bias;
+    }
+    return res;
+}
+
+std::vector<ResampleResult> Resampler::jackknife(const std::vector<Derived>& f, int threads) const{
+    //the means without block b follow from the sums in O(1) per series
+    threads = (threads <= 0) ? omp_get_max_threads() : threads;
+    const size_t K = this->series();
+    std::vector<double> theta(_n*f.size());
+    //a quantity that throws must not end the parallel region, so the first exception is kept and rethrown afterwards
+    std::exception_ptr error = nullptr;
+    std::atomic<bool> failed(false);
+    #pragma omp parallel num_threads(threads)
+    {
+        std::vector<double> means(K);
+        #pragma omp for schedule(static)
+        for (size_t b=0; b<_n; b++){
+            if (failed.load(std::memory_order_relaxed)){
+                continue;
+            }
+            for (size_t k=0; k<K; k++){
+                means[k] = (_sums[k] - _blocks[k][b])/(_n-1);
+            }
+            try{
+                for (size_t i=0; i<f.size(); i++){
+                    theta[b*f.size() + i] = f[i](means);
+                }
+            }
+            catch (...){
+                #pragma omp critical
+                {
+                    if (error == nullptr){
+                        error = std::current_exception();
+                    }
+                }
+                failed = true;
+            }
+        }
+    }
+    if (error != nullptr){
+        std::rethrow_exception(error);
+    }
+    return collect(f, _means, theta, _n, true);
+}
+
+std::vector<ResampleResult> Resampler::bootstrap(const std::vector<Derived>& f, const size_t& resamples, const uint64_t& seed, int threads) const{
+    if (resamples < 2){
+        throw std::runtime_error("Bootstrap needs at least 2 resamples");
+    }
+    threads = (threads <= 0) ? omp_get_max_threads() : threads;
+    //a stream that no chain draws from: a fresh one for every call with the global seed, and the last stream id (never given by next_stream) for an explicit seed
+    const uint64_t key = (seed == 0) ? global_seed() : seed;
+    const uint64_t stream = (seed == 0) ? next_stream() : std::numeric_limits<uint64_t>::max();
+    const uint64_t blocks = (_n + 3)/4; //Philox blocks per resample
+    const size_t K = this->series();
+    std::vector<double> theta(resamples*f.size());
+    std::exception_ptr error = nullptr; //as in jackknife
+    std::atomic<bool> failed(false);
+    #pragma omp parallel num_threads(threads)
+    {
+        //a resample is stored as the number of times each block was drawn, in buffers that every thread reuses
+        std::vector<uint32_t> counts(_n);
+        std::vector<double> means(K);
+        #pragma omp for schedule(dynamic, 4)
+        for (size_t r=0; r<resamples; r++){
+            if (failed.load(std::memory_order_relaxed)){
+                continue;
+            }
+            Philox gen(key, stream);
+            gen.set_position(r*blocks, 0);
+            std::fill(counts.begin(), counts.end(), 0);
+            for (size_t j=0; j<_n; j++){
+                counts[(uint64_t(gen())*_n) >> 32]++;
+            }
+            for (size_t k=0; k<K; k++){
+                const double* x = _blocks[k].data();
+                double s = 0;
+                #pragma omp simd reduction(+:s)
+                for (size_t b=0; b<_n; b++){
+                    s += counts[b]*x[b];
+                }
+                means[k] = s/_n;
+            }
+            try{
+                for (size_t i=0; i<f.size(); i++){
+                    theta[r*f.size() + i] = f[i](means);
+                }
+            }
+            catch (...){
+                #pragma omp critical
+                {
+                    if (error == nullptr){
+                        error = std::current_exception();
+                    }
+                }
+                failed = true;
+            }
+        }
+    }
+    if (error != nullptr){
+        std::rethrow_exception(error);
+    }
+    return collect(f, _means, theta, resamples, false);
+}
+
+
+Resampler thermo_resampler(const std::vector<double>& E, const std::vector<double>& M, const size_t& bin_size){
+    if (E.size() != M.size()){
+        throw std::runtime_error("E and M need to have the same length");
+    }
+    //the energy is shifted by its mean, so that <E^2> - <E>^2 does not cancel
+    const double E0 = E.empty() ? 0 : mean_value(E);
+    std::vector<std::vector<double>> series(5, std::vector<double>(E.size()));
+    #pragma omp parallel for schedule(static) if(E.size() >= PARALLEL_STATS)
+    for (size_t i=0; i<E.size(); i++){
+        const double e = E[i] - E0, m2 = M[i]*M[i];
+        series[0][i] = e;
+        series[1][i] = e*e;
+        series[2][i] = std::abs(M[i]);
+        series[3][i] = m2;
+        series[4][i] = m2*m2;
+    }
+    return Resampler(series, bin_size);
+}
+
+Derived specific_heat(const double& T, const size_t& N){
+    return [T, N](const std::vector<double>& m){ return (m[1] - m[0]*m[0])/(N*T*T);};
+}
+
+Derived susceptibility(const double& T, const size_t& N){
+    return [T, N](const std::vector<double>& m){ return (m[3] - m[2]*m[2])/(N*T);};
+}
+
+Derived binder_cumulant(){
+    return [](const std::vector<double>& m){ return 1 - m[4]/(3*m[3]*m[3]);};
+}
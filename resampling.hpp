@@ -0,0 +1,83 @@
+#ifndef RESAMPLING_HPP
+#define RESAMPLING_HPP
+
+#include "tools.hpp"
+#include "rng.hpp"
+#include <functional>
+
+using Derived = std::function<double(const std::vector<double>& means)>; //derived quantity, from the means of all series of a Resampler
+
+struct ResampleResult;
+
+class Resampler;
+
+
+struct ResampleResult{
+
+    double estimate = 0; //f of the means of the whole sample
+    double value = 0; //bias corrected estimate
+    double bias = 0;
+    double error = 0;
+
+    std::string message() const;
+};
+
+
+class Resampler{
+
+    /*
+    Jackknife and bootstrap error analysis of quantities derived from several series that were measured together
+    (e.g. E and E^2 for the specific heat). Entry i of all series must belong to the same measurement, so that their correlations are kept.
+    The series are first reduced to block means of bin_size consecutive entries, and all resampling works on the blocks,
+    so bin_size needs to be larger than the autocorrelation time (see BinningAnalysis). If the series do not fill a whole
+    number of blocks, the first entries are dropped.
+    Many derived quantities can be analyzed from the same resamples at once. They are evaluated in parallel, so they must be thread safe.
+    */
+
+public:
+
+    Resampler(const std::vector<std::vector<double>>& series, const size_t& bin_size=1);
+
+    inline size_t series() const{ return _blocks.size();}
+
+    inline size_t blocks() const{ return _n;} //number of blocks used for resampling
+
+    inline const std::vector<double>& means() const{ return _means;}
+
+    std::vector<ResampleResult> jackknife(const std::vector<Derived>& f, int threads=-1) const;
+
+    std::vector<ResampleResult> bootstrap(const std::vector<Derived>& f, const size_t& resamples=1000, const uint64_t& seed=0, int threads=-1) const; //resample r draws the r-th segment of a Philox stream reserved for the call, whatever the number of threads. seed = 0 uses the global seed and a new stream on every call
+
+    inline ResampleResult jackknife(const Derived& f, int threads=-1) const{ return this->jackknife(std::vector<Derived>{f}, threads)[0];}
+
+    inline ResampleResult bootstrap(const Derived& f, const size_t& resamples=1000, const uint64_t& seed=0, int threads=-1) const{
+        return this->bootstrap(std::vector<Derived>{f}, resamples, seed, threads)[0];
+    }
+
+private:
+
+    size_t _n = 0;
+    std::vector<std::vector<double>> _blocks; //_blocks[k][b]: mean of block b of series k
+    std::vector<double> _sums; //sum of the block means of each series
+    std::vector<double> _means;
+};
+
+
+/*
+Thermodynamic quantities of a spin model from its total energy E and magnetization M at temperature T, with N sites.
+thermo_resampler builds the series E-E0, (E-E0)^2, |M|, M^2, M^4 (E0: mean of E), on which the following derived quantities are defined:
+    specific_heat: (<E^2> - <E>^2)/(N T^2)
+    susceptibility: (<M^2> - <|M|>^2)/(N T)
+    binder_cumulant: 1 - <M^4>/(3 <M^2>^2)
+*/
+
+Resampler thermo_resampler(const std::vector<double>& E, const std::vector<double>& M, const size_t& bin_size=1);
+
+Derived specific_heat(const double& T, const size_t& N);
+
+Derived susceptibility(const double& T, const size_t& N);
+
+Derived binder_cumulant();
+
+
+#endif
@@ -0,0 +1,200 @@
+#include "reweighting.hpp"
+#include <algorithm>
+#include <limits>
+#include <map>
+
+
+JointHistogram::JointHistogram(const double& T, const double& dE, const double& dM) : _T(T), _dE(dE), _dM(dM){
+    if (!(T > 0) || !(dE > 0) || !(dM > 0)){
+        throw std::runtime_error("A histogram needs a positive temperature and bin widths");
+    }
+}
+
+JointHistogram& JointHistogram::operator+=(const JointHistogram& other){
+    if (other._T != _T || other._dE != _dE || other._dM != _dM){
+        throw std::runtime_error("Only histograms of the same temperature and bin widths can be merged");
+    }
+    for (const auto& [key, count] : other._counts){
+        _counts[key] += count;
+    }
+    _n += other._n;
+    return *this;
+}
+
+std::vector<JointHistogram::Bin> JointHistogram::bins() const{
+    std::vector<Bin> res;
+    res.reserve(_counts.size());
+    for (const auto& [key, count] : _counts){
+        res.push_back({int32_t(uint32_t(key >> 32))*_dE, int32_t(uint32_t(key))*_dM, count});
+    }
+    std::sort(res.begin(), res.end(), [](const Bin& a, const Bin& b){ return (a.E < b.E) || (a.E == b.E && a.M < b.M);});
+    return res;
+}
+
+void JointHistogram::save(BinaryWriter& out) const{
+    out.write(_T);
+    out.write(_dE);
+    out.write(_dM);
+    out.write<uint64_t>(_n);
+    out.write<uint64_t>(_counts.size());
+    for (const auto& [key, count] : _counts){
+        out.write(key);
+        out.write(count);
+    }
+}
+
+void JointHistogram::load(BinaryReader& in){
+    _T = in.read<double>();
+    _dE = in.read<double>();
+    _dM = in.read<double>();
+    _n = in.read<uint64_t>();
+    const size_t n = in.read<uint64_t>();
+    _counts.clear();
+    for (size_t i=0; i<n; i++){
+        const uint64_t key = in.read<uint64_t>();
+        _counts[key] = in.read<uint64_t>();
+    }
+}
+
+
+Reweighting::Reweighting(const std::vector<JointHistogram>& histograms, const size_t& N, const double& tol, const size_t& max_iter) : _N(N){
+    const size_t R = histograms.size();
+    if (R == 0){
+        throw std::runtime_error("Reweighting needs at least one histogram");
+    }
+    for (const JointHistogram& h : histograms){
+        if (h.dE() != histograms[0].dE() || h.dM() != histograms[0].dM()){
+            throw std::runtime_error("All histograms need the same bin widths");
+        }
+        if (h.N() == 0){
+            throw std::runtime_error("Reweighting needs histograms with at least one measurement");
+        }
+    }
+
+    //union of the bins, and the energy marginal
+    std::map<std::pair<double, double>, uint64_t> joint;
+    for (const JointHistogram& h : histograms){
+        for (const JointHistogram::Bin& b : h.bins()){
+            joint[{b.E, b.M}] += b.count;
+        }
+    }
+    _bins.reserve(joint.size());
+    std::vector<double> E; //distinct energies, in increasing order
+    std::vector<double> log_H; //log of the total count of each energy
+    std::vector<size_t> level(joint.size()); //energy index of each bin
+    double total = 0, E_sum = 0;
+    for (const auto& [x, count] : joint){
+        if (E.empty() || E.back() != x.first){
+            E.push_back(x.first);
+            log_H.push_back(0);
+        }
+        log_H.back() += count; //counts for now
+        level[_bins.size()] = E.size()-1;
+        _bins.push_back({x.first, x.second, count});
+        total += count;
+        E_sum += count*x.first;
+    }
+    _E0 = E_sum/total;
+    for (double& h : log_H){
+        h = std::log(h);
+    }
+
+    std::vector<double> beta(R), log_n(R);
+    for (size_t r=0; r<R; r++){
+        beta[r] = 1/histograms[r].T();
+        log_n[r] = std::log(double(histograms[r].N()));
+    }
+
+    //WHAM iterations on the energy marginal. log_denom[e] = log sum_r n_r exp(f_r - beta_r E)
+    const size_t L = E.size();
+    _f.assign(R, 0);
+    std::vector<double> log_denom(L), log_g(L), f_new(R);
+    auto denominators = [&](){
+        #pragma omp parallel if(L*R > 65536)
+        {
+            std::vector<double> x(R);
+            #pragma omp for schedule(static)
+            for (size_t e=0; e<L; e++){
+                for (size_t r=0; r<R; r++){
+                    x[r] = log_n[r] + _f[r] - beta[r]*(E[e] - _E0);
+                }
+                log_denom[e] = log_sum_exp(x.data(), R);
+            }
+        }
+    };
+    for (_iterations=0; _iterations<max_iter; _iterations++){
+        denominators();
+        for (size_t e=0; e<L; e++){
+            log_g[e] = log_H[e] - log_denom[e];
+        }
+        #pragma omp parallel if(L*R > 65536)
+        {
+            std::vector<double> x(L);
+            #pragma omp for schedule(static)
+            for (size_t r=0; r<R; r++){
+                for (size_t e=0; e<L; e++){
+                    x[e] = log_g[e] - beta[r]*(E[e] - _E0);
+                }
+                f_new[r] = -log_sum_exp(x.data(), L);
+            }
+        }
+        double change = 0;
+        for (size_t r=0; r<R; r++){
+            f_new[r] -= f_new[0];
+            change = std::max(change, std::abs(f_new[r] - _f[r]));
+        }
+        _f = f_new;
+        if (change < tol){
+            break;
+        }
+    }
+    denominators();
+
+    //the joint density of states shares the denominators of its energy
+    _log_g.resize(_bins.size());
+    for (size_t i=0; i<_bins.size(); i++){
+        _log_g[i] = std::log(double(_bins[i].count)) - log_denom[level[i]];
+    }
+}
+
+ReweightedPoint Reweighting::at(const double& T) const{
+    //Boltzmann weights relative to the largest one. Energies are measured from _E0, which only changes log_Z by a constant
+    const double beta = 1/T;
+    const size_t n = _bins.size();
+    double m = -std::numeric_limits<double>::infinity();
+    for (size_t i=0; i<n; i++){
+        m = std::max(m, _log_g[i] - beta*(_bins[i].E - _E0));
+    }
+    double Z = 0, e1 = 0, e2 = 0, am = 0, m2 = 0, m4 = 0;
+    for (size_t i=0; i<n; i++){
+        const double w = std::exp(_log_g[i] - beta*(_bins[i].E - _E0) - m);
+        const double e = _bins[i].E - _E0, M = _bins[i].M, M2 = M*M;
+        Z += w;
+        e1 += w*e;
+        e2 += w*e*e;
+        am += w*std::abs(M);
+        m2 += w*M2;
+        m4 += w*M2*M2;
+    }
+    e1 /= Z; e2 /= Z; am /= Z; m2 /= Z; m4 /= Z;
+    ReweightedPoint res;
+    res.T = T;
+    res.energy = (e1 + _E0)/_N;
+    res.specific_heat = (e2 - e1*e1)/(_N*T*T);
+    res.abs_M = am/_N;
+    res.M2 = m2/(double(_N)*_N);
+    res.susceptibility = (m2 - am*am)/(_N*T);
+    res.binder_cumulant = 1 - m4/(3*m2*m2);
+    res.log_Z = m + std::log(Z) - beta*_E0;
+    return res;
+}
+
+std::vector<ReweightedPoint> Reweighting::curve(const std::vector<double>& T, int threads) const{
+    threads = (threads <= 0) ? omp_get_max_threads() : threads;
+    std::vector<ReweightedPoint> res(T.size());
+    #pragma omp parallel for num_threads(threads) schedule(dynamic)
+    for (size_t i=0; i<T.size(); i++){
+        res[i] = this->at(T[i]);
+    }
+    return res;
+}
@@ -0,0 +1,121 @@
+#ifndef REWEIGHTING_HPP
+#define REWEIGHTING_HPP
+
+#include "tools.hpp"
+#include <unordered_map>
+
+class JointHistogram;
+
+struct ReweightedPoint;
+
+class Reweighting;
+
+
+class JointHistogram{
+
+    /*
+    Counts of the (energy, magnetization) pairs measured at temperature T, in bins of width dE and dM
+    (1 for the exact values of integer models). Only visited bins are stored, so the size follows the
+    fluctuations of the simulation and not the size of the lattice.
+    */
+
+public:
+
+    struct Bin{
+        double E;
+        double M;
+        uint64_t count;
+    };
+
+    JointHistogram(const double& T=1, const double& dE=1, const double& dM=1);
+
+    inline void add(const double& E, const double& M){
+        _counts[_key(std::llround(E/_dE), std::llround(M/_dM))]++;
+        _n++;
+    }
+
+    JointHistogram& operator+=(const JointHistogram& other); //both must have the same T and bin widths
+
+    inline const double& T() const{ return _T;}
+
+    inline const double& dE() const{ return _dE;}
+
+    inline const double& dM() const{ return _dM;}
+
+    inline uint64_t N() const{ return _n;} //number of measurements
+
+    inline size_t size() const{ return _counts.size();} //number of visited bins
+
+    std::vector<Bin> bins() const; //visited bins, sorted by E and then M
+
+    inline void reset(){ _counts.clear(); _n = 0;}
+
+    void save(BinaryWriter& out) const;
+
+    void load(BinaryReader& in);
+
+private:
+
+    double _T, _dE, _dM;
+    uint64_t _n = 0;
+    std::unordered_map<uint64_t, uint64_t> _counts;
+
+    static inline uint64_t _key(const int64_t& e, const int64_t& m){ return (uint64_t(uint32_t(int32_t(e))) << 32) | uint32_t(int32_t(m));}
+};
+
+
+struct ReweightedPoint{
+
+    //thermal averages at one temperature, per site where noted (N sites)
+
+    double T = 0;
+    double energy = 0; //<E>/N
+    double specific_heat = 0; //(<E^2> - <E>^2)/(N T^2)
+    double abs_M = 0; //<|M|>/N
+    double M2 = 0; //<M^2>/N^2
+    double susceptibility = 0; //(<M^2> - <|M|>^2)/(N T)
+    double binder_cumulant = 0; //1 - <M^4>/(3 <M^2>^2)
+    double log_Z = 0; //log of the partition function, up to a constant that is the same for all temperatures
+};
+
+
+class Reweighting{
+
+    /*
+    Thermal averages at any temperature from joint histograms measured at one or more temperatures.
+    With a single histogram this is Ferrenberg-Swendsen reweighting. With several, the density of states is first estimated
+    with the multi-histogram (WHAM) equations
+        g(E, M) = sum_r H_r(E, M) / sum_r n_r exp(f_r - E/T_r),     exp(-f_r) = sum_{E, M} g(E, M) exp(-E/T_r)
+    which are iterated on the energy marginal until the free energies f_r change by less than tol.
+    Every sum is done in logarithms (log-sum-exp), so the huge Boltzmann factors of large lattices never overflow.
+    Reweighting is only reliable at temperatures whose energy distribution is well covered by the histograms.
+    */
+
+public:
+
+    Reweighting(const std::vector<JointHistogram>& histograms, const size_t& N, const double& tol=1e-10, const size_t& max_iter=100000);
+
+    ReweightedPoint at(const double& T) const;
+
+    std::vector<ReweightedPoint> curve(const std::vector<double>& T, int threads=-1) const; //all temperatures in parallel
+
+    inline const std::vector<double>& free_energies() const{ return _f;} //f_r = -log Z_r of every histogram, relative to the first one
+
+    inline size_t iterations() const{ return _iterations;}
+
+    inline const std::vector<double>& log_g() const{ return _log_g;} //log of the density of states of every bin of bins(), up to a constant
+
+    inline const std::vector<JointHistogram::Bin>& bins() const{ return _bins;} //union of the visited bins, with the total counts
+
+private:
+
+    size_t _N;
+    std::vector<JointHistogram::Bin> _bins;
+    std::vector<double> _log_g;
+    std::vector<double> _f;
+    double _E0; //energy shift of the sums, so that the moments of E do not cancel
+    size_t _iterations = 0;
+};
+
+
+#endif
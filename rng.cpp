@@ -0,0 +1,102 @@
+#include "rng.hpp"
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+
+
+static std::mutex _seed_mutex;
+static bool _seeded = false;
+static uint64_t _seed = 0;
+static std::atomic<uint64_t> _stream{0};
+
+
+void set_global_seed(const uint64_t& seed){
+    std::lock_guard<std::mutex> lock(_seed_mutex);
+    _seed = seed;
+    _seeded = true;
+    _stream = 0;
+}
+
+uint64_t global_seed(){
+    std::lock_guard<std::mutex> lock(_seed_mutex);
+    if (!_seeded){
+        std::random_device rd;
+        _seed = (uint64_t(rd()) << 32) | rd();
+        _seeded = true;
+    }
+    return _seed;
+}
+
+uint64_t next_stream(){
+    return _stream++;
+}
+
+
+Philox::Philox(const uint64_t& seed, const uint64_t& stream, const uint32_t& substream){
+    this->seed(seed, stream, substream);
+}
+
+void Philox::seed(const uint64_t& seed, const uint64_t& stream, const uint32_t& substream){
+    _key = seed;
+    _stream = stream;
+    _substream = substream;
+    _counter = 0;
+    _index = 4;
+}
+
+Philox Philox::substream(const uint32_t& k) const{
+    return Philox(_key, _stream, k);
+}
+
+void Philox::set_position(const uint64_t& counter, const unsigned& index){
+    if (index > 4){
+        throw std::runtime_error("Invalid Philox block index");
+    }
+    _counter = counter;
+    _index = 4;
+    if (index < 4){
+        _block = _generate(_counter++);
+        _index = index;
+    }
+}
+
+void Philox::fill_uniform(double* out, const size_t& n){
+    size_t i = 0;
+    //use up the current block, so that the output is identical to calling uniform() n times
+    while (i < n && _index < 4){
+        out[i++] = this->uniform();
+    }
+    //every block gives two doubles, and blocks are independent of each other
+    const size_t blocks = (n-i)/2;
+    #pragma omp simd
+    for (size_t b=0; b<blocks; b++){
+        const std::array<uint32_t, 4> x = _generate(_counter + b);
+        out[i+2*b] = _to_double(x[0], x[1]);
+        out[i+2*b+1] = _to_double(x[2], x[3]);
+    }
+    _counter += blocks;
+    i += 2*blocks;
+    if (i < n){
+        out[i] = this->uniform();
+    }
+}
+
+std::array<uint32_t, 4> Philox::_generate(const uint64_t& counter) const{
+    //counter words: (block counter, substream, stream). key words: seed
+    uint32_t c0 = uint32_t(counter), c1 = uint32_t(counter >> 32) ^ (_substream << 16), c2 = uint32_t(_stream), c3 = uint32_t(_stream >> 32);
+    uint32_t k0 = uint32_t(_key), k1 = uint32_t(_key >> 32);
+    for (int r=0; r<10; r++){
+        const uint64_t p0 = uint64_t(0xD2511F53) * c0;
+        const uint64_t p1 = uint64_t(0xCD9E8D57) * c2;
+        const uint32_t n0 = uint32_t(p1 >> 32) ^ c1 ^ k0;
+        const uint32_t n2 = uint32_t(p0 >> 32) ^ c3 ^ k1;
+        c1 = uint32_t(p1);
+        c3 = uint32_t(p0);
+        c0 = n0;
+        c2 = n2;
+        k0 += 0x9E3779B9;
+        k1 += 0xBB67AE85;
+    }
+    return {c0, c1, c2, c3};
+}
@@ -0,0 +1,90 @@
+#ifndef RNG_HPP
+#define RNG_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <limits>
+
+class Philox;
+
+void set_global_seed(const uint64_t& seed); //generators created afterwards without an explicit seed use this seed, and the streams 0, 1, 2... in order of creation
+
+uint64_t global_seed(); //drawn from std::random_device, unless set_global_seed has been called
+
+uint64_t next_stream(); //a stream id that has not been given to any other generator of this process (thread safe)
+
+inline uint64_t acceptance_threshold(const double& p){ return (p < 1) ? uint64_t(p*4294967296.) : uint64_t(1) << 32;} //a raw 32-bit random number r is below the threshold with probability p (to 2^-32)
+
+
+class Philox{
+
+    /*
+    Counter-based generator (Philox4x32-10).
+    Every block of 4 random 32-bit numbers is a pure function of (seed, stream, substream, counter),
+    with up to 2^16 substreams per stream and 2^48 blocks per substream,
+    so generators with different streams or substreams are independent, any state is reproducible
+    from a handful of integers, and blocks can be generated in any order (and in parallel).
+    Satisfies UniformRandomBitGenerator, so it can be used with the std distributions.
+    */
+
+public:
+
+    using result_type = uint32_t;
+
+    Philox() : Philox(global_seed(), next_stream()){}
+
+    Philox(const uint64_t& seed, const uint64_t& stream, const uint32_t& substream=0);
+
+    static constexpr result_type min(){ return 0;}
+
+    static constexpr result_type max(){ return std::numeric_limits<uint32_t>::max();}
+
+    inline result_type operator()(){
+        if (_index == 4){
+            _block = _generate(_counter++);
+            _index = 0;
+        }
+        return _block[_index++];
+    }
+
+    inline uint64_t next_u64(){ return (uint64_t((*this)()) << 32) | (*this)();}
+
+    inline double uniform(){ return _to_double((*this)(), (*this)());} //in [0, 1) with 53 random bits
+
+    void fill_uniform(double* out, const size_t& n); //same as calling uniform() n times, but whole blocks are generated in a vectorizable loop
+
+    void seed(const uint64_t& seed, const uint64_t& stream, const uint32_t& substream=0);
+
+    Philox substream(const uint32_t& k) const; //independent generator with the same seed and stream, starting from counter 0
+
+    inline const uint64_t& seed() const{ return _key;}
+
+    inline const uint64_t& stream() const{ return _stream;}
+
+    inline const uint32_t& substream() const{ return _substream;}
+
+    inline const uint64_t& counter() const{ return _counter;} //number of blocks generated
+
+    inline const unsigned& index() const{ return _index;} //numbers already used from the current block
+
+    void set_position(const uint64_t& counter, const unsigned& index); //restores the state returned by counter() and index()
+
+private:
+
+    uint64_t _key;
+    uint64_t _stream;
+    uint32_t _substream;
+    uint64_t _counter = 0;
+    std::array<uint32_t, 4> _block = {};
+    unsigned _index = 4;
+
+    std::array<uint32_t, 4> _generate(const uint64_t& counter) const;
+
+    static inline double _to_double(const uint32_t& a, const uint32_t& b){
+        return ((a >> 5) * 67108864.0 + (b >> 6)) * (1.0/9007199254740992.0);
+    }
+};
+
+
+#endif
@@ -0,0 +1,124 @@
+#include "tempering.hpp"
+
+
+static size_t ladder_pairs(const std::vector<double>& temperatures){
+    //number of neighboring pairs, checked before any member is sized with it
+    if (temperatures.size() < 2){
+        throw std::runtime_error("Parallel tempering requires at least 2 temperatures");
+    }
+    return temperatures.size()-1;
+}
+
+ParallelTempering::ParallelTempering(const std::vector<double>& temperatures, const size_t& Lx, const size_t& Ly) : _attempts(ladder_pairs(temperatures), 0), _accepted(_attempts.size(), 0){
+    for (const double& T : temperatures){
+        _sims.push_back(new IsingModel2D(T, Lx, Ly));
+    }
+}
+
+ParallelTempering::ParallelTempering(const ParallelTempering& other) : _attempts(other._attempts), _accepted(other._accepted), _parity(other._parity), _gen(other._gen.seed(), next_stream()){
+    for (const IsingModel2D* sim : other._sims){
+        _sims.push_back(new IsingModel2D(*sim));
+    }
+}
+
+ParallelTempering& ParallelTempering::operator=(const ParallelTempering& other){
+    if (&other != this){
+        _clear();
+        for (const IsingModel2D* sim : other._sims){
+            _sims.push_back(new IsingModel2D(*sim));
+        }
+        _attempts = other._attempts;
+        _accepted = other._accepted;
+        _parity = other._parity;
+        _gen = Philox(other._gen.seed(), next_stream());
+    }
+    return *this;
+}
+
+ParallelTempering::~ParallelTempering(){
+    _clear();
+}
+
+std::vector<double> ParallelTempering::temperatures() const{
+    std::vector<double> res(_sims.size());
+    for (size_t k=0; k<_sims.size(); k++){
+        res[k] = _sims[k]->T();
+    }
+    return res;
+}
+
+void ParallelTempering::add_observable(const std::string& name){
+    for (IsingModel2D* sim : _sims){
+        sim->add_observable(name);
+    }
+}
+
+void ParallelTempering::update(const std::string& method, const size_t& rounds, const size_t& steps, const size_t& sweeps, int threads){
+    std::vector<MonteCarlo*> sims(_sims.begin(), _sims.end());
+    for (size_t r=0; r<rounds; r++){
+        update_all(sims, method, steps, sweeps, threads);
+        this->exchange();
+    }
+}
+
+void ParallelTempering::exchange(){
+    for (size_t k=_parity; k+1<_sims.size(); k+=2){
+        const double b1 = 1/_sims[k]->T(), b2 = 1/_sims[k+1]->T();
+        const double E1 = _sims[k]->chain().energy(), E2 = _sims[k+1]->chain().energy();
+        _attempts[k]++;
+        if (_gen.uniform() < std::exp((b1-b2)*(E1-E2))){
+            _sims[k]->exchange_chain(*_sims[k+1]);
+            _accepted[k]++;
+        }
+    }
+    _parity = 1 - _parity;
+}
+
+std::vector<double> ParallelTempering::acceptance_rates() const{
+    std::vector<double> res(_attempts.size());
+    for (size_t k=0; k<res.size(); k++){
+        res[k] = (_attempts[k] > 0) ? double(_accepted[k])/_attempts[k] : 0;
+    }
+    return res;
+}
+
+void ParallelTempering::tune(){
+    //The spacing of each pair is scaled by the square root of its acceptance rate (relative to the mean rate), so that pairs that
+    //rarely swap are brought closer together. The square root damps the correction, so tune() is meant to be called repeatedly.
+    //The total range of the ladder is preserved.
+    const std::vector<double> rates = this->acceptance_rates();
+    std::vector<double> T = this->temperatures();
+    std::vector<double> dT(rates.size());
+    const double mean_rate = mean_value(rates) + 1e-3;
+    double total = 0, new_total = 0;
+    for (size_t k=0; k<dT.size(); k++){
+        total += T[k+1] - T[k];
+        dT[k] = (T[k+1] - T[k]) * std::sqrt((rates[k] + 1e-3) / mean_rate);
+        new_total += dT[k];
+    }
+    for (size_t k=0; k<dT.size()-1; k++){
+        T[k+1] = T[k] + dT[k]*total/new_total;
+        _sims[k+1]->set_T(T[k+1]);
+    }
+    for (IsingModel2D* sim : _sims){
+        sim->reset_observables();
+        if (sim->recording_histogram()){
+            //restarted at the new temperature
+            const double dE = sim->histogram().dE(), dM = sim->histogram().dM();
+            sim->record_histogram(sim->T(), dE, dM);
+        }
+    }
+    this->reset_rates();
+}
+
+void ParallelTempering::reset_rates(){
+    std::fill(_attempts.begin(), _attempts.end(), 0);
+    std::fill(_accepted.begin(), _accepted.end(), 0);
+}
+
+void ParallelTempering::_clear(){
+    for (IsingModel2D* sim : _sims){
+        delete sim;
+    }
+    _sims.clear();
+}
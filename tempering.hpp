@@ -0,0 +1,64 @@
+#ifndef TEMPERING_HPP
+#define TEMPERING_HPP
+
+#include "ising.hpp"
+
+class ParallelTempering;
+
+
+class ParallelTempering{
+
+    /*
+    Replica exchange over a ladder of IsingModel2D simulations.
+    sim(k) always has temperature temperatures()[k] and keeps the statistics of that temperature.
+    Between exchange rounds all simulations are advanced in parallel through update_all,
+    and then neighboring temperatures attempt to swap their configurations with the Metropolis criterion.
+    A swap only exchanges the chain pointers of the two simulations, the lattices are never copied.
+    */
+
+public:
+
+    ParallelTempering(const std::vector<double>& temperatures, const size_t& Lx, const size_t& Ly);
+
+    ParallelTempering(const ParallelTempering& other);
+
+    ParallelTempering& operator=(const ParallelTempering& other);
+
+    ~ParallelTempering();
+
+    inline size_t replicas() const{ return _sims.size();}
+
+    inline const IsingModel2D& sim(const size_t& k) const{ return *_sims.at(k);}
+
+    inline IsingModel2D& sim(const size_t& k){ return *_sims.at(k);}
+
+    inline const std::vector<IsingModel2D*>& sims() const{ return _sims;}
+
+    std::vector<double> temperatures() const;
+
+    void add_observable(const std::string& name); //registers a built-in observable in every simulation
+
+    void update(const std::string& method, const size_t& rounds, const size_t& steps=1, const size_t& sweeps=0, int threads=-1); //each round, every simulation performs update(method, steps, sweeps) and then an exchange is attempted
+
+    void exchange(); //attempts to swap every other pair of neighboring temperatures, alternating between even and odd pairs on each call
+
+    std::vector<double> acceptance_rates() const; //swap acceptance rate of each pair (k, k+1)
+
+    void tune(); //redistributes the intermediate temperatures so that the acceptance rates become more uniform. The end points stay fixed. The observables and acceptance rates are reset, and recorded histograms restart at the new temperatures. Stored states are kept
+
+    void reset_rates();
+
+private:
+
+    std::vector<IsingModel2D*> _sims;
+    std::vector<size_t> _attempts;
+    std::vector<size_t> _accepted;
+    size_t _parity = 0;
+    Philox _gen;
+
+    void _clear();
+
+};
+
+
+#endif
@@ -8,12 +8,27 @@ std::vector<double> pow(const std::vector<double>& x, const double& p){
     return res;
 }
 
-double mean_value(const std::vector<double>& x){
-    return sum(x)/x.size();
+double mean_value(const std::vector<double>& x, int threads){
+    return sum(x, threads)/x.size();
 }
 
-double sample_std(const std::vector<double>& x){
-    return std::sqrt(mean_value(pow(x, 2)) - pow(mean_value(x), 2));
+double sample_std(const std::vector<double>& x, int threads){
+    return std::sqrt(moments(x, threads).var());
+}
+
+double log_sum_exp(const double* x, const size_t& n){
+    double m = -std::numeric_limits<double>::infinity();
+    for (size_t i=0; i<n; i++){
+        m = std::max(m, x[i]);
+    }
+    if (!std::isfinite(m)){
+        return m;
+    }
+    double s = 0;
+    for (size_t i=0; i<n; i++){
+        s += std::exp(x[i] - m);
+    }
+    return m + std::log(s);
 }
 
 
@@ -33,6 +48,22 @@ std::string Sample::message() const{
     return std::to_string(this->mean()) + " +/- " + std::to_string(this->error());
 }
 
+std::string Accumulator::message() const{
+    return std::to_string(this->mean()) + " +/- " + std::to_string(this->error());
+}
+
+void Accumulator::save(BinaryWriter& out) const{
+    out.write<uint64_t>(_m.n);
+    out.write(_m.mean);
+    out.write(_m.m2);
+}
+
+void Accumulator::load(BinaryReader& in){
+    _m.n = in.read<uint64_t>();
+    _m.mean = in.read<double>();
+    _m.m2 = in.read<double>();
+}
+
 BinningAnalysis Sample::bin_it() const{
     return this->sample;
 }
@@ -65,11 +96,325 @@ void BinningAnalysis::_init(std::vector<double> sample){ //passing a modifiable
 
 }
 
-std::vector<State*> copy_states(const std::vector<State*>& states){
+void BinningAccumulator::add(const double& x){
+    double value = x;
+    for (size_t l=0; ; l++){
+        if (l == _levels.size()){
+            _levels.push_back(Accumulator());
+            _pending.push_back(0);
+            _has_pending.push_back(false);
+        }
+        _levels[l].add(value);
+        if (!_has_pending[l]){
+            _pending[l] = value;
+            _has_pending[l] = true;
+            return;
+        }
+        //a bin of the next level is complete
+        value = (_pending[l] + value)/2.;
+        _has_pending[l] = false;
+    }
+}
+
+size_t BinningAccumulator::max_level() const{
+    size_t res = 0;
+    while (res < _levels.size() && _levels[res].N() >= _min_bins){
+        res++;
+    }
+    return res;
+}
+
+double BinningAccumulator::tau_estimate() const{
+    return 0.5 * (pow(this->binned_error()/this->error(0), 2) - 1);
+}
+
+bool BinningAccumulator::converged() const{
+    size_t levels = this->max_level();
+    if (levels < 5){
+        return false;
+    }
+    double rel_change = 0;
+    for (size_t l=levels-3; l<levels; l++){
+        rel_change += (this->error(l)-this->error(l-1))/this->error(l);
+    }
+    return (rel_change/3 <= 0.05);
+}
+
+void BinningAccumulator::reset(){
+    _levels.clear();
+    _pending.clear();
+    _has_pending.clear();
+}
+
+void BinningAccumulator::save(BinaryWriter& out) const{
+    out.write<uint64_t>(_min_bins);
+    out.write<uint64_t>(_levels.size());
+    for (size_t l=0; l<_levels.size(); l++){
+        _levels[l].save(out);
+        out.write(_pending[l]);
+        out.write<uint8_t>(_has_pending[l]);
+    }
+}
+
+void BinningAccumulator::load(BinaryReader& in){
+    _min_bins = in.read<uint64_t>();
+    const size_t levels = in.read<uint64_t>();
+    this->reset();
+    for (size_t l=0; l<levels; l++){
+        _levels.push_back(Accumulator());
+        _levels.back().load(in);
+        _pending.push_back(in.read<double>());
+        _has_pending.push_back(in.read<uint8_t>());
+    }
+}
 
-    std::vector<State*> res(states.size());
-    for (size_t i=0; i<states.size(); i++){
-        res[i] = states[i]->clone();
+size_t State::snapshot_bytes() const{
+    size_t res = this->snapshot_itemsize();
+    for (const size_t& n : this->snapshot_shape()){
+        res *= n;
     }
     return res;
+}
+
+void State::save(BinaryWriter& out) const{
+    std::vector<char> data(this->snapshot_bytes());
+    this->snapshot(data.data());
+    out.write_vector(this->snapshot_shape());
+    out.write_vector(data);
+}
+
+void State::load(BinaryReader& in){
+    if (in.read_vector<size_t>() != this->snapshot_shape()){
+        throw std::runtime_error("The saved state has a different shape than the current one");
+    }
+    std::vector<char> data = in.read_vector<char>();
+    if (data.size() != this->snapshot_bytes()){
+        throw std::runtime_error("Corrupted state in checkpoint");
+    }
+    this->load_snapshot(data.data());
+}
+
+Trajectory::Trajectory(const Trajectory& other) : _shape(other._shape), _format(other._format), _itemsize(other._itemsize), _frame_bytes(other._frame_bytes){
+    _reallocate(other._n);
+    std::copy(other.data(), other.data() + other._n*_frame_bytes, _buffer.get());
+    _n = other._n;
+}
+
+Trajectory& Trajectory::operator=(const Trajectory& other){
+    if (&other != this){
+        *this = Trajectory(other);
+    }
+    return *this;
+}
+
+void Trajectory::append(const State& state){
+    _check_writable();
+    if (_n == 0){
+        _set_layout(state);
+    }
+    else if (state.snapshot_bytes() != _frame_bytes){
+        throw std::runtime_error("All states of a trajectory need to have the same size");
+    }
+    if (_n == _capacity){
+        _reallocate(std::max<size_t>(2*_capacity, 16));
+    }
+    state.snapshot(_buffer.get() + _n*_frame_bytes);
+    _n++;
+    if (_file){
+        _write_header();
+    }
+}
+
+void Trajectory::load(const size_t& i, State& state) const{
+    if (i >= _n){
+        throw std::out_of_range("Snapshot index out of range");
+    }
+    state.load_snapshot(this->frame(i));
+}
+
+void Trajectory::reserve(const size_t& n){
+    _check_writable();
+    if (n > _capacity && _frame_bytes > 0){
+        _reallocate(n);
+    }
+}
+
+void Trajectory::prepare(const State& state, const size_t& n){
+    _check_writable();
+    if (_n == 0){
+        _set_layout(state);
+    }
+    if (_n + n > _capacity){
+        _reallocate(std::max(_n + n, 2*_capacity));
+    }
+}
+
+void Trajectory::clear(){
+    _check_writable();
+    if (_buffer.use_count() > 1){
+        //a view still holds the snapshots
+        _buffer = nullptr;
+        _capacity = 0;
+        if (_file){
+            _file = std::make_shared<MappedFile>(_file->path(), MappedFile::Mode::Create);
+        }
+    }
+    _n = 0;
+    if (_file){
+        _write_header();
+    }
+}
+
+void Trajectory::to_file(const std::string& path){
+    std::shared_ptr<const char[]> old = _buffer;
+    const size_t n = _n;
+    _file = std::make_shared<MappedFile>(path, MappedFile::Mode::Create);
+    _buffer = nullptr;
+    _capacity = 0;
+    _n = 0;
+    if (n > 0){
+        _reallocate(n);
+        std::copy(old.get(), old.get() + n*_frame_bytes, _buffer.get());
+        _n = n;
+    }
+    _write_header();
+}
+
+void Trajectory::open_file(const std::string& path, const size_t& n){
+    this->_open(path, n, MappedFile::Mode::Append);
+}
+
+void Trajectory::read_file(const std::string& path){
+    this->_open(path, -1, MappedFile::Mode::Read);
+}
+
+void Trajectory::_open(const std::string& path, const size_t& n, const MappedFile::Mode& mode){
+    std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>(path, mode);
+    if (file->size() < FILE_HEADER){
+        throw std::runtime_error("\"" + path + "\" is not a trajectory file");
+    }
+    std::shared_ptr<char[]> map = file->map(FILE_HEADER);
+    const uint64_t* header = reinterpret_cast<const uint64_t*>(map.get());
+    if (std::memcmp(map.get(), "MCPYTRJ1", 8) != 0 || header[4] > (FILE_HEADER-40)/8){
+        throw std::runtime_error("\"" + path + "\" is not a trajectory file");
+    }
+    std::vector<size_t> shape(header+5, header+5+header[4]);
+    size_t frame_bytes = header[2];
+    for (const size_t& k : shape){
+        frame_bytes *= k;
+    }
+    if (n != size_t(-1) && n > header[1]){
+        throw std::runtime_error("The trajectory file \"" + path + "\" holds fewer snapshots than requested");
+    }
+    _shape = shape;
+    _itemsize = header[2];
+    _format = char(header[3]);
+    _frame_bytes = frame_bytes;
+    _n = std::min<size_t>(n, header[1]);
+    _file = file;
+    _buffer = nullptr;
+    _capacity = 0;
+    if (file->read_only()){
+        //only the snapshots that the header counts are mapped, and the header is left as it is
+        _reallocate(_n);
+        return;
+    }
+    _reallocate(std::max<size_t>(_n, (file->size()-FILE_HEADER)/std::max<size_t>(_frame_bytes, 1)));
+    _write_header();
+}
+
+void Trajectory::save(BinaryWriter& out) const{
+    out.write_string("Trajectory");
+    out.write<uint8_t>(_file != nullptr);
+    if (_file){
+        out.write_string(_file->path());
+        out.write<uint64_t>(_n);
+    }
+    else{
+        out.write_vector(_shape);
+        out.write(_format);
+        out.write<uint64_t>(_itemsize);
+        out.write<uint64_t>(_n);
+        out.write_bytes(this->data(), _n*_frame_bytes);
+    }
+}
+
+void Trajectory::load(BinaryReader& in){
+    in.expect("Trajectory");
+    if (in.read<uint8_t>()){
+        const std::string path = in.read_string();
+        const size_t n = in.read<uint64_t>();
+        if (MappedFile::in_use(path)){
+            //another trajectory (a copy, or the simulation that was saved) still appends to the file, so this one gets its first n snapshots in memory instead
+            Trajectory file;
+            file.read_file(path);
+            if (n > file._n){
+                throw std::runtime_error("The trajectory file \"" + path + "\" holds fewer snapshots than requested");
+            }
+            file._n = n;
+            *this = Trajectory(file);
+            return;
+        }
+        this->open_file(path, n);
+        return;
+    }
+    Trajectory res;
+    res._shape = in.read_vector<size_t>();
+    res._format = in.read<char>();
+    res._itemsize = in.read<uint64_t>();
+    res._frame_bytes = res._itemsize;
+    for (const size_t& k : res._shape){
+        res._frame_bytes *= k;
+    }
+    const size_t n = in.read<uint64_t>();
+    res._reallocate(n);
+    in.read_bytes(res._buffer.get(), n*res._frame_bytes);
+    res._n = n;
+    *this = std::move(res);
+}
+
+void Trajectory::_reallocate(const size_t& capacity){
+    if (_file){
+        //the file already holds the snapshots, only the mapping grows
+        std::shared_ptr<char[]> map = _file->map(FILE_HEADER + capacity*_frame_bytes);
+        _buffer = std::shared_ptr<char[]>(map, map.get() + FILE_HEADER);
+        _capacity = capacity;
+        return;
+    }
+    std::shared_ptr<char[]> buffer(new char[std::max<size_t>(capacity*_frame_bytes, 1)]);
+    if (_n > 0){
+        std::copy(this->data(), this->data() + _n*_frame_bytes, buffer.get());
+    }
+    _buffer = buffer;
+    _capacity = capacity;
+}
+
+void Trajectory::_write_header(){
+    //magic, N, itemsize, format, ndim, shape... as 64-bit words
+    if (!_buffer){
+        _reallocate(0);
+    }
+    char* header = _buffer.get() - FILE_HEADER;
+    std::vector<uint64_t> words = {0, _n, _itemsize, uint64_t(_format), _shape.size()};
+    words.insert(words.end(), _shape.begin(), _shape.end());
+    std::memcpy(words.data(), "MCPYTRJ1", 8);
+    std::memcpy(header, words.data(), words.size()*8);
+    _file->set_final_size(FILE_HEADER + _n*_frame_bytes);
+}
+
+void Trajectory::_check_writable() const{
+    if (_file && _file->read_only()){
+        throw std::runtime_error("The trajectory file \"" + _file->path() + "\" is open for reading only");
+    }
+}
+
+void Trajectory::_set_layout(const State& state){
+    _shape = state.snapshot_shape();
+    _format = state.snapshot_format();
+    _itemsize = state.snapshot_itemsize();
+    if (state.snapshot_bytes() != _frame_bytes){
+        _capacity = 0;
+        _buffer = nullptr;
+    }
+    _frame_bytes = state.snapshot_bytes();
 }
\ No newline at end of file
@@ -2,33 +2,160 @@
 #define TOOLS_HPP
 
 #include <vector>
+#include <array>
 #include <string>
 #include <iostream>
 #include <cmath>
 #include <memory>
 #include <omp.h>
+#include <cstdint>
+#include "io.hpp"
+
+struct Moments;
 
 std::vector<double> pow(const std::vector<double>& x, const double& p);
 
-double mean_value(const std::vector<double>& x);
+//Statistics of large samples. threads <= 0 uses all threads, but only for samples of at least PARALLEL_STATS entries.
+//The results do not depend on the number of threads
+
+double mean_value(const std::vector<double>& x, int threads=-1);
+
+double sample_std(const std::vector<double>& x, int threads=-1); //sqrt(<(x-<x>)^2>), without Bessel's correction
 
-double sample_std(const std::vector<double>& x);
+double log_sum_exp(const double* x, const size_t& n); //log(sum_i exp(x_i)) without overflow. -inf entries are allowed
 
 std::vector<double> bin_it(const std::vector<double>& data);//assumes data is divisible by 2. Returns a vector with exactly half elements, each one is the mean of 2 consecutive elements of the original vector.
 
+
+constexpr size_t STATS_BLOCK = 4096; //entries per block of the statistics kernels. A block stays in cache for a second pass
+
+constexpr size_t PARALLEL_STATS = 1 << 18;
+
+constexpr size_t LOCAL_BLOCKS = 16; //reduce_blocks keeps up to this many partial results on the stack
+
+
+struct Moments{
+
+    /*
+    Count, mean and sum of squared deviations from the mean of a set of values.
+    Values are added with Welford's update, and two sets combine exactly (Chan et al.),
+    so partial results of threads or chunks can be merged in any grouping.
+    Unlike running sums of x and x^2, the variance does not cancel when the mean is large compared with the spread.
+    */
+
+    uint64_t n = 0;
+    double mean = 0;
+    double m2 = 0;
+
+    inline void add(const double& x){
+        n++;
+        const double d = x - mean;
+        mean += d/n;
+        m2 += d*(x - mean);
+    }
+
+    inline Moments& operator+=(const Moments& other){
+        if (other.n == 0){
+            return *this;
+        }
+        const uint64_t total = n + other.n;
+        const double d = other.mean - mean;
+        mean += d*other.n/total;
+        m2 += other.m2 + d*d*(double(n)*other.n/total);
+        n = total;
+        return *this;
+    }
+
+    inline double var() const{ return m2/n;} //<(x-<x>)^2>
+};
+
+template<class Scalar>
+double pairwise_sum(const Scalar* x, const size_t& n){
+    //accumulated in double whatever the type of x. Short ranges are summed in a vectorized loop, longer ones recursively in halves, so the rounding error grows as log(n)
+    if (n <= 256){
+        double res = 0;
+        #pragma omp simd reduction(+:res)
+        for (size_t i=0; i<n; i++){
+            res += x[i];
+        }
+        return res;
+    }
+    const size_t h = n/2;
+    return pairwise_sum(x, h) + pairwise_sum(x+h, n-h);
+}
+
 template<class Scalar>
-double sum(const std::vector<Scalar>& x){
-    Scalar res = 0;
-    for (size_t i=0; i<x.size(); i++){
-        res += x[i];
+Moments block_moments(const Scalar* x, const size_t& n){
+    //two passes over a block that stays in cache: the mean, and then the squared deviations from it
+    if (n == 0){
+        return Moments();
+    }
+    const double mean = pairwise_sum(x, n)/n;
+    double m2 = 0;
+    #pragma omp simd reduction(+:m2)
+    for (size_t i=0; i<n; i++){
+        const double d = x[i] - mean;
+        m2 += d*d;
+    }
+    return {n, mean, m2};
+}
+
+template<class T, class Block>
+T reduce_blocks(const size_t& n, int threads, const Block& block){
+    //block(i0, n) of every block of STATS_BLOCK entries, merged with += in a binary tree.
+    //The blocks and the tree do not depend on the number of threads, so neither does the result
+    const size_t blocks = (n + STATS_BLOCK - 1)/STATS_BLOCK;
+    if (blocks == 0){
+        return T();
     }
-    return res;
+    else if (blocks == 1){
+        return block(0, n);
+    }
+    threads = (threads <= 0) ? ((n >= PARALLEL_STATS) ? omp_get_max_threads() : 1) : threads;
+    //the partial results of small samples stay on the stack, so that e.g. the magnetization of a lattice allocates nothing
+    std::array<T, LOCAL_BLOCKS> local;
+    std::vector<T> heap((blocks > LOCAL_BLOCKS) ? blocks : 0);
+    T* const part = (blocks > LOCAL_BLOCKS) ? heap.data() : local.data();
+    #pragma omp parallel for num_threads(threads) schedule(static) if(threads > 1 && blocks > 1)
+    for (size_t b=0; b<blocks; b++){
+        part[b] = block(b*STATS_BLOCK, std::min(STATS_BLOCK, n - b*STATS_BLOCK));
+    }
+    for (size_t stride=1; stride<blocks; stride*=2){
+        for (size_t b=0; b+stride<blocks; b+=2*stride){
+            part[b] += part[b+stride];
+        }
+    }
+    return part[0];
+}
+
+template<class Scalar>
+double sum(const Scalar* x, const size_t& n, int threads=-1){
+    return reduce_blocks<double>(n, threads, [x](const size_t& i0, const size_t& m){ return pairwise_sum(x+i0, m);});
+}
+
+template<class Scalar>
+double sum(const std::vector<Scalar>& x, int threads=-1){
+    return sum(x.data(), x.size(), threads);
+}
+
+template<class Scalar>
+Moments moments(const Scalar* x, const size_t& n, int threads=-1){
+    return reduce_blocks<Moments>(n, threads, [x](const size_t& i0, const size_t& m){ return block_moments(x+i0, m);});
+}
+
+template<class Scalar>
+Moments moments(const std::vector<Scalar>& x, int threads=-1){
+    return moments(x.data(), x.size(), threads);
 }
 
 struct Sample;
 
 struct BinningAnalysis;
 
+struct Accumulator;
+
+struct BinningAccumulator;
+
 struct Sample{
 
     /*
@@ -101,6 +228,103 @@ protected:
 };
 
 
+struct Accumulator{
+
+    /*
+    Compact running statistics of an observable.
+    Values are added one at a time and never stored,
+    so memory does not grow with the number of measurements.
+    The statistics have the same meaning as the corresponding methods of Sample.
+    */
+
+    inline void add(const double& x){ _m.add(x);}
+
+    inline Accumulator& operator+=(const Accumulator& other){ _m += other._m; return *this;} //exact, e.g. for statistics of several threads or runs
+
+    inline size_t N() const{ return _m.n;}
+
+    inline double mean() const{
+        return _m.mean;
+    }
+
+    inline double std() const{
+        return std::sqrt(_m.var());
+    }
+
+    inline double popul_std() const{
+        return this->std()*sqrt(this->N()/(this->N()-1.));
+    }
+
+    inline double error() const{
+        return this->std()/sqrt(this->N()-1.);
+    }
+
+    inline const Moments& moments() const{ return _m;}
+
+    inline void reset(){
+        _m = Moments();
+    }
+
+    std::string message() const;
+
+    void save(BinaryWriter& out) const;
+
+    void load(BinaryReader& in);
+
+private:
+    Moments _m;
+};
+
+
+struct BinningAccumulator{
+
+    /*
+    Streaming version of BinningAnalysis.
+    Every binning level keeps only its running statistics and at most one pending value
+    that waits for its partner to form the next bin, so memory grows as log2(N).
+    Values can be fed one at a time while the simulation runs,
+    and all queries are valid at any moment.
+
+    Only levels with at least min_bins bins are considered reliable,
+    same as in BinningAnalysis.
+    */
+
+    BinningAccumulator(const size_t& min_bins = 64):_min_bins(min_bins){}
+
+    void add(const double& x);
+
+    inline size_t N() const{ return _levels.empty() ? 0 : _levels[0].N();}
+
+    inline double mean() const{ return _levels.at(0).mean();}
+
+    inline double std() const{ return _levels.at(0).std();}
+
+    inline double error(const size_t& level=0) const{ return _levels.at(level).error();}
+
+    inline double binned_error() const{ return this->error(this->max_level()-1);} //error bar that accounts for autocorrelations
+
+    size_t max_level() const; //number of reliable levels, including level 0
+
+    double tau_estimate() const;
+
+    bool converged() const;
+
+    inline const std::vector<Accumulator>& levels() const{ return _levels;}
+
+    void reset();
+
+    void save(BinaryWriter& out) const;
+
+    void load(BinaryReader& in);
+
+private:
+    size_t _min_bins;
+    std::vector<Accumulator> _levels = {};
+    std::vector<double> _pending = {};
+    std::vector<bool> _has_pending = {};
+};
+
+
 struct State{
 
     virtual ~State() = default;
@@ -108,10 +332,123 @@ struct State{
     virtual State* clone() const = 0;
 
     virtual std::unique_ptr<State> safe_clone() const = 0;
+
+    //A snapshot is the configuration written as a contiguous array of the given shape.
+    //The format is a buffer protocol character ('b': int8, 'd': double...) with the corresponding itemsize.
+
+    virtual std::vector<size_t> snapshot_shape() const = 0;
+
+    virtual char snapshot_format() const{ return 'b';}
+
+    virtual size_t snapshot_itemsize() const{ return 1;}
+
+    virtual void snapshot(void* out) const = 0;
+
+    virtual void load_snapshot(const void* in) = 0;
+
+    size_t snapshot_bytes() const;
+
+    //Checkpoint of the configuration. By default this is the snapshot, and a loaded snapshot needs to have the shape of the current one.
+    //States that can change their size while loading, or that have a more compact form, override both.
+
+    virtual void save(BinaryWriter& out) const;
+
+    virtual void load(BinaryReader& in);
 };
 
 
-std::vector<State*> copy_states(const std::vector<State*>& states);
+class Trajectory{
+
+    /*
+    Snapshots of N states of the same kind, stored contiguously as one (N, *shape) array.
+    The layout is taken from the first state that is appended.
+
+    The buffer is shared with any view obtained through buffer(). Stored snapshots are never modified:
+    appending either writes past the end of all existing views, or moves the trajectory to a new buffer,
+    and clear() only reuses the buffer when no view holds it. So a view remains valid (and unchanged) for as long as it is held.
+    Copies of a trajectory do not share their buffer.
+
+    The snapshots can also be streamed to an append-only file (see to_file), which is mapped in memory instead of the buffer,
+    so that long runs do not keep their trajectory in RAM. The file starts with a header of FILE_HEADER bytes
+    (see _write_header) followed by the (N, *shape) array, and the header always holds the current N,
+    so the file stays readable if the process is killed.
+    */
+
+public:
+
+    Trajectory() = default;
+
+    Trajectory(const Trajectory& other);
+
+    Trajectory(Trajectory&& other) = default;
+
+    Trajectory& operator=(const Trajectory& other);
+
+    Trajectory& operator=(Trajectory&& other) = default;
+
+    void append(const State& state);
+
+    void load(const size_t& i, State& state) const; //overwrites the configuration of a state with the i-th snapshot
+
+    void reserve(const size_t& n);
+
+    void prepare(const State& state, const size_t& n); //makes room for n more snapshots of state at once: the buffer grows directly to the final size (or doubles, if that is larger)
+
+    void clear();
+
+    void to_file(const std::string& path); //creates (or replaces) the file at path, copies the stored snapshots in it, and appends all further snapshots to it
+
+    void open_file(const std::string& path, const size_t& n=-1); //continues a trajectory file written earlier, keeping only its first n snapshots (all of them by default)
+
+    void read_file(const std::string& path); //maps the snapshots of a trajectory file without ever modifying it (the file may still be written by another trajectory). Nothing can be appended
+
+    inline std::string file() const{ return _file ? _file->path() : "";} //path of the trajectory file, or empty if the trajectory is in memory
+
+    static constexpr size_t FILE_HEADER = 4096; //bytes before the first snapshot in a trajectory file
+
+    void save(BinaryWriter& out) const; //the snapshots themselves, or only the file path and N if the trajectory is in a file
+
+    void load(BinaryReader& in); //a saved file is continued, unless another trajectory still writes it: then its snapshots are copied in memory
+
+    inline size_t N() const{ return _n;}
+
+    inline const char* data() const{ return _buffer.get();}
+
+    inline const char* frame(const size_t& i) const{ return _buffer.get() + i*_frame_bytes;}
+
+    inline std::shared_ptr<const char[]> buffer() const{ return _buffer;}
+
+    inline const std::vector<size_t>& shape() const{ return _shape;} //shape of a single snapshot
+
+    inline const char& format() const{ return _format;}
+
+    inline const size_t& itemsize() const{ return _itemsize;}
+
+    inline const size_t& frame_bytes() const{ return _frame_bytes;}
+
+    inline const size_t& capacity() const{ return _capacity;}
+
+private:
+
+    std::vector<size_t> _shape = {};
+    char _format = 'b';
+    size_t _itemsize = 1;
+    size_t _frame_bytes = 0;
+    size_t _n = 0;
+    size_t _capacity = 0; //number of snapshots that fit in the buffer
+    std::shared_ptr<char[]> _buffer = nullptr;
+    std::shared_ptr<MappedFile> _file = nullptr;
+
+    void _reallocate(const size_t& capacity);
+
+    void _open(const std::string& path, const size_t& n, const MappedFile::Mode& mode);
+
+    void _check_writable() const;
+
+    void _write_header();
+
+    void _set_layout(const State& state);
+};
 
 
 #endif
\ No newline at end of file
@@ -0,0 +1,394 @@
+#include "wanglandau.hpp"
+
+
+WangLandauChain::WangLandauChain(const size_t& Lx, const size_t& Ly, const long int& E_min, const long int& E_max) : MarkovChain(SpinState(std::vector<int>(Lx*Ly, 1), Lx, Ly)), _E_min(E_min), _E_max(E_max){
+    const long int N = Lx*Ly;
+    if (E_min >= E_max || E_min < -2*N || E_max > 2*N || E_min % 2 != 0 || E_max % 2 != 0){
+        throw std::runtime_error("An energy window needs even bounds E_min < E_max within [-2N, 2N]");
+    }
+    _allocate();
+    _enter_window();
+}
+
+UpdateMethod WangLandauChain::method(const std::string& name) const{
+    if (name == "wl"){
+        return static_method<WangLandauChain, &WangLandauChain::wl_update>();
+    }
+    else if (name == "muca"){
+        return static_method<WangLandauChain, &WangLandauChain::muca_update>();
+    }
+    else{
+        throw std::runtime_error("Unknown update method \"" + name + "\"");
+    }
+}
+
+void WangLandauChain::wl_update(){
+    this->_step<false>();
+}
+
+void WangLandauChain::muca_update(){
+    this->_step<true>();
+}
+
+template<bool Muca>
+void WangLandauChain::_step(){
+    SpinState& S = static_cast<SpinState&>(*this->_state);
+    const size_t k = _spin_roulette(this->_gen);
+    const long int E = _E + _delta(k);
+    size_t b = _bin(_E);
+    bool accept = false;
+    if (_inside(E)){
+        const double d = _log_g[b] - _log_g[_bin(E)];
+        accept = (d >= 0) || (this->draw_uniform(0, 1) < std::exp(d));
+    }
+    if (accept){
+        _E = E;
+        _M -= 2*S.spins[k];
+        S.spins[k] *= -1;
+        b = _bin(E);
+    }
+    _H[b]++;
+    _visited[b] = 1;
+    if constexpr (Muca){
+        const double M2 = double(_M)*_M;
+        _samples[b]++;
+        _abs_M[b] += std::abs(_M);
+        _M2[b] += M2;
+        _M4[b] += M2*M2;
+    }
+    else{
+        _log_g[b] += _ln_f;
+    }
+    if (this->counting()){
+        _counters.proposals++;
+        _counters.accepted += accept;
+    }
+}
+
+bool WangLandauChain::flat(const double& flatness) const{
+    uint64_t min = std::numeric_limits<uint64_t>::max(), total = 0, n = 0;
+    for (size_t b=0; b<_H.size(); b++){
+        if (_visited[b]){
+            min = std::min(min, _H[b]);
+            total += _H[b];
+            n++;
+        }
+    }
+    return (n > 0) && (min > 0) && (min >= flatness*double(total)/n);
+}
+
+void WangLandauChain::refine(){
+    _ln_f /= 2;
+    this->clear_histogram();
+}
+
+void WangLandauChain::reweight(){
+    for (size_t b=0; b<_H.size(); b++){
+        if (_H[b] > 0){
+            _log_g[b] += std::log(double(_H[b]));
+        }
+    }
+    this->clear_histogram();
+}
+
+long int WangLandauChain::_delta(const size_t& k) const{
+    const SpinState& S = this->ising_state();
+    const auto [hx, hy] = S.local_field(k);
+    return 2*S.spins[k]*(hx + hy);
+}
+
+void WangLandauChain::_enter_window(){
+    //Windows below E = 0 start from the ground state, and the others from the checkerboard state (the highest energy).
+    //Then only flips that do not increase the distance to the window are accepted, until the energy is inside
+    SpinState& S = static_cast<SpinState&>(*this->_state);
+    const size_t Lx = S.shape[0], Ly = S.shape[1];
+    const bool high = (_E_min + _E_max > 0);
+    for (size_t j=0; j<Ly; j++){
+        for (size_t i=0; i<Lx; i++){
+            S.spins[j*Lx + i] = (high && (i+j) % 2 == 1) ? -1 : 1;
+        }
+    }
+    _E = S.energy();
+    _M = S.M();
+    auto distance = [this](const long int& E){ return (E < _E_min) ? _E_min - E : ((E > _E_max) ? E - _E_max : 0);};
+    const size_t max_flips = 10000*S.sites();
+    for (size_t n=0; n<max_flips && !_inside(_E); n++){
+        const size_t k = _spin_roulette(this->_gen);
+        const long int E = _E + _delta(k);
+        if (distance(E) <= distance(_E)){
+            _E = E;
+            _M -= 2*S.spins[k];
+            S.spins[k] *= -1;
+        }
+    }
+    if (!_inside(_E)){
+        throw std::runtime_error("Could not reach the energy window [" + std::to_string(_E_min) + ", " + std::to_string(_E_max) + "]");
+    }
+}
+
+void WangLandauChain::_allocate(){
+    const size_t bins = (_E_max - _E_min)/2 + 1;
+    _spin_roulette = std::uniform_int_distribution<size_t>(0, this->ising_state().sites()-1);
+    _log_g.assign(bins, 0);
+    _H.assign(bins, 0);
+    _visited.assign(bins, 0);
+    _samples.assign(bins, 0);
+    _abs_M.assign(bins, 0);
+    _M2.assign(bins, 0);
+    _M4.assign(bins, 0);
+}
+
+void WangLandauChain::save(BinaryWriter& out) const{
+    out.write_string("WangLandauChain");
+    MarkovChain::save(out);
+    out.write<int64_t>(_E_min);
+    out.write<int64_t>(_E_max);
+    out.write(_ln_f);
+    out.write_vector(_log_g);
+    out.write_vector(_H);
+    out.write_vector(_visited);
+    out.write_vector(_samples);
+    out.write_vector(_abs_M);
+    out.write_vector(_M2);
+    out.write_vector(_M4);
+}
+
+void WangLandauChain::load(BinaryReader& in){
+    in.expect("WangLandauChain");
+    MarkovChain::load(in);
+    _E_min = in.read<int64_t>();
+    _E_max = in.read<int64_t>();
+    _ln_f = in.read<double>();
+    _allocate();
+    _log_g = in.read_vector<double>();
+    _H = in.read_vector<uint64_t>();
+    _visited = in.read_vector<uint8_t>();
+    _samples = in.read_vector<uint64_t>();
+    _abs_M = in.read_vector<double>();
+    _M2 = in.read_vector<double>();
+    _M4 = in.read_vector<double>();
+    _E = this->ising_state().energy();
+    _M = this->ising_state().M();
+    if (_log_g.size() != this->bins() || _H.size() != this->bins() || !_inside(_E)){
+        throw std::runtime_error("Corrupted Wang-Landau chain in checkpoint");
+    }
+}
+
+size_t WangLandauChain::memory() const{
+    size_t res = this->ising_state().spins.capacity()*sizeof(int) + _visited.capacity();
+    res += (_log_g.capacity() + _abs_M.capacity() + _M2.capacity() + _M4.capacity())*sizeof(double);
+    res += (_H.capacity() + _samples.capacity())*sizeof(uint64_t);
+    return res;
+}
+
+
+DensityOfStates::DensityOfStates(const std::vector<double>& E, const std::vector<double>& log_g, const size_t& N, const std::vector<double>& abs_M, const std::vector<double>& M2, const std::vector<double>& M4) : _E(E), _log_g(log_g), _abs_M(abs_M), _M2(M2), _M4(M4), _N(N){
+    const size_t n = E.size();
+    if (n == 0 || log_g.size() != n || abs_M.size() != n || M2.size() != n || M4.size() != n){
+        throw std::runtime_error("A density of states needs the same (non zero) number of energies and values");
+    }
+}
+
+ReweightedPoint DensityOfStates::at(const double& T) const{
+    //weights g(E) exp(-E/T) relative to the largest one, and the energy variance around the mean (a second pass), so that it does not cancel
+    const double beta = 1/T;
+    const size_t n = _E.size();
+    std::vector<double> w(n);
+    for (size_t i=0; i<n; i++){
+        w[i] = _log_g[i] - beta*_E[i];
+    }
+    const double m = *std::max_element(w.begin(), w.end());
+    double Z = 0, e1 = 0, Zm = 0, am = 0, m2 = 0, m4 = 0;
+    for (size_t i=0; i<n; i++){
+        w[i] = std::exp(w[i] - m);
+        Z += w[i];
+        e1 += w[i]*_E[i];
+        if (!std::isnan(_abs_M[i])){
+            Zm += w[i];
+            am += w[i]*_abs_M[i];
+            m2 += w[i]*_M2[i];
+            m4 += w[i]*_M4[i];
+        }
+    }
+    e1 /= Z;
+    double e2 = 0;
+    for (size_t i=0; i<n; i++){
+        e2 += w[i]*(_E[i] - e1)*(_E[i] - e1);
+    }
+    e2 /= Z;
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    am = (Zm > 0) ? am/Zm : nan;
+    m2 = (Zm > 0) ? m2/Zm : nan;
+    m4 = (Zm > 0) ? m4/Zm : nan;
+    ReweightedPoint res;
+    res.T = T;
+    res.energy = e1/_N;
+    res.specific_heat = e2/(_N*T*T);
+    res.abs_M = am/_N;
+    res.M2 = m2/(double(_N)*_N);
+    res.susceptibility = (m2 - am*am)/(_N*T);
+    res.binder_cumulant = 1 - m4/(3*m2*m2);
+    res.log_Z = m + std::log(Z);
+    return res;
+}
+
+std::vector<ReweightedPoint> DensityOfStates::curve(const std::vector<double>& T, int threads) const{
+    threads = (threads <= 0) ? omp_get_max_threads() : threads;
+    std::vector<ReweightedPoint> res(T.size());
+    #pragma omp parallel for num_threads(threads) schedule(dynamic)
+    for (size_t i=0; i<T.size(); i++){
+        res[i] = this->at(T[i]);
+    }
+    return res;
+}
+
+
+WangLandau::WangLandau(const size_t& Lx, const size_t& Ly, const size_t& windows, const double& overlap) : WangLandau(Lx, Ly, -2*long(Lx*Ly), 2*long(Lx*Ly), windows, overlap){}
+
+WangLandau::WangLandau(const size_t& Lx, const size_t& Ly, const long int& E_min, const long int& E_max, const size_t& windows, const double& overlap) : _N(Lx*Ly){
+    //the bounds are widened to even energies (all energies of the model are even)
+    _E_min = E_min - ((E_min % 2 != 0) ? 1 : 0);
+    _E_max = E_max + ((E_max % 2 != 0) ? 1 : 0);
+    if (windows == 0 || !(overlap >= 0 && overlap < 1) || (windows > 1 && overlap == 0)){
+        throw std::runtime_error("Wang-Landau needs at least one window, and an overlap in (0, 1) if there are several");
+    }
+    //n windows of w bins, where consecutive ones share a fraction overlap of their bins
+    const size_t bins = (_E_max - _E_min)/2 + 1;
+    const size_t w = std::min(bins, size_t(std::ceil(bins/(windows - (windows-1)*overlap))));
+    std::vector<size_t> start(windows, 0);
+    for (size_t k=1; k<windows; k++){
+        start[k] = std::llround(double(k)*(bins - w)/(windows-1));
+        if (start[k-1] + w < start[k] + 2){
+            throw std::runtime_error("The energy windows are too narrow to overlap. Use fewer windows or a larger overlap");
+        }
+    }
+    _chains.reserve(windows);
+    for (size_t k=0; k<windows; k++){
+        _chains.emplace_back(Lx, Ly, _E_min + 2*long(start[k]), _E_min + 2*long(start[k] + w - 1));
+    }
+}
+
+bool WangLandau::run(const double& flatness, const double& final_ln_f, const size_t& check_sweeps, const size_t& max_sweeps, int threads){
+    if (check_sweeps == 0){
+        throw std::runtime_error("check_sweeps must be positive");
+    }
+    else if (!(flatness > 0 && flatness <= 1)){
+        throw std::runtime_error("The flatness must be in (0, 1]");
+    }
+    else if (max_sweeps == 0 && !(final_ln_f > 0)){
+        throw std::runtime_error("final_ln_f must be positive when max_sweeps is 0, or the run never ends");
+    }
+    threads = (threads <= 0) ? omp_get_max_threads() : threads;
+    #pragma omp parallel for num_threads(threads) schedule(dynamic, 1)
+    for (size_t k=0; k<_chains.size(); k++){
+        WangLandauChain& chain = _chains[k];
+        const UpdateMethod wl = chain.method("wl");
+        for (size_t sweeps=0; chain.ln_f() >= final_ln_f && (max_sweeps == 0 || sweeps < max_sweeps); sweeps += check_sweeps){
+            wl.run(chain, check_sweeps*_N);
+            if (chain.flat(flatness)){
+                chain.refine();
+            }
+        }
+    }
+    for (const WangLandauChain& chain : _chains){
+        if (chain.ln_f() >= final_ln_f){
+            return false;
+        }
+    }
+    return true;
+}
+
+void WangLandau::production(const size_t& sweeps, const size_t& iterations, int threads){
+    threads = (threads <= 0) ? omp_get_max_threads() : threads;
+    #pragma omp parallel for num_threads(threads) schedule(dynamic, 1)
+    for (size_t k=0; k<_chains.size(); k++){
+        WangLandauChain& chain = _chains[k];
+        const UpdateMethod muca = chain.method("muca");
+        chain.clear_histogram();
+        for (size_t it=0; it<iterations; it++){
+            muca.run(chain, sweeps*_N);
+            chain.reweight();
+        }
+    }
+}
+
+DensityOfStates WangLandau::density_of_states() const{
+    const size_t bins = (_E_max - _E_min)/2 + 1;
+    std::vector<double> log_g(bins, 0), abs_M(bins, 0), M2(bins, 0), M4(bins, 0);
+    std::vector<uint8_t> have(bins, 0);
+    std::vector<uint64_t> samples(bins, 0);
+    for (size_t k=0; k<_chains.size(); k++){
+        const WangLandauChain& c = _chains[k];
+        const size_t offset = (c.E_min() - _E_min)/2;
+        //the microcanonical measurements do not depend on the weights, so the overlapping windows are simply added
+        for (size_t b=0; b<c.bins(); b++){
+            samples[offset+b] += c.samples()[b];
+            abs_M[offset+b] += c.abs_M()[b];
+            M2[offset+b] += c.M2()[b];
+            M4[offset+b] += c.M4()[b];
+        }
+        size_t junction = 0;
+        double shift = 0;
+        if (k > 0){
+            std::vector<size_t> common;
+            for (size_t b=0; b<c.bins(); b++){
+                if (have[offset+b] && c.visited()[b]){
+                    common.push_back(b);
+                }
+            }
+            if (common.empty()){
+                throw std::runtime_error("Energy windows " + std::to_string(k-1) + " and " + std::to_string(k) + " have no visited energy in common");
+            }
+            junction = common[0];
+            double best = std::numeric_limits<double>::infinity();
+            for (size_t i=0; i+1<common.size(); i++){
+                const size_t a = common[i], b = common[i+1];
+                const double slope_diff = std::abs((log_g[offset+b] - log_g[offset+a]) - (c.log_g()[b] - c.log_g()[a]));
+                if (slope_diff < best){
+                    best = slope_diff;
+                    junction = a;
+                }
+            }
+            shift = log_g[offset+junction] - c.log_g()[junction];
+        }
+        for (size_t b=junction; b<c.bins(); b++){
+            have[offset+b] = c.visited()[b];
+            log_g[offset+b] = c.log_g()[b] + shift;
+        }
+    }
+
+    std::vector<double> E, g, am, m2, m4;
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    for (size_t b=0; b<bins; b++){
+        if (have[b]){
+            E.push_back(_E_min + 2*long(b));
+            g.push_back(log_g[b]);
+            am.push_back(samples[b] > 0 ? abs_M[b]/samples[b] : nan);
+            m2.push_back(samples[b] > 0 ? M2[b]/samples[b] : nan);
+            m4.push_back(samples[b] > 0 ? M4[b]/samples[b] : nan);
+        }
+    }
+    if (E.empty()){
+        throw std::runtime_error("The Wang-Landau walkers have not visited any energy yet");
+    }
+    //normalized to 2^N states
+    const double norm = _N*std::log(2.) - log_sum_exp(g.data(), g.size());
+    for (double& x : g){
+        x += norm;
+    }
+    return DensityOfStates(E, g, _N, am, m2, m4);
+}
+
+void WangLandau::set_counting(const bool& on){
+    for (WangLandauChain& chain : _chains){
+        chain.set_counting(on);
+    }
+}
+
+ChainCounters WangLandau::counters() const{
+    ChainCounters res;
+    for (const WangLandauChain& chain : _chains){
+        res += chain.counters();
+    }
+    return res;
+}
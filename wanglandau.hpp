@@ -0,0 +1,188 @@
+#ifndef WANGLANDAU_HPP
+#define WANGLANDAU_HPP
+
+#include "ising.hpp"
+
+class WangLandauChain;
+
+class DensityOfStates;
+
+class WangLandau;
+
+
+class WangLandauChain : public MarkovChain{
+
+    /*
+    Flat-histogram random walk of a periodic 2D Ising lattice over the energies [E_min, E_max] (a window of the spectrum).
+    The energies are binned exactly (every even integer), and moves that leave the window are rejected.
+    Both methods propose the same single spin flips as ssf, with the same incremental energy change:
+        "wl": Wang-Landau. A move E -> E' is accepted with min(1, g(E)/g(E')), and then log g of the current energy grows by ln_f
+        "muca": multicanonical. Same acceptance, with the weights 1/g(E) fixed. The microcanonical averages of |M|, M^2 and M^4 are accumulated
+    Both fill the energy histogram of the current stage.
+    */
+
+public:
+
+    WangLandauChain(const size_t& Lx, const size_t& Ly, const long int& E_min, const long int& E_max); //the initial state is walked into the window
+
+    inline MarkovChain* clone() const override{ return new WangLandauChain(*this);}
+
+    inline std::unique_ptr<MarkovChain> safe_clone() const override{ return std::make_unique<WangLandauChain>(*this);}
+
+    UpdateMethod method(const std::string& name) const override;
+
+    void wl_update();
+
+    void muca_update();
+
+    bool flat(const double& flatness) const; //every visited energy has a histogram count of at least flatness times the mean count
+
+    void refine(); //next Wang-Landau stage: ln_f is halved and the histogram is cleared
+
+    inline void clear_histogram(){ std::fill(_H.begin(), _H.end(), 0);}
+
+    void reweight(); //multicanonical recursion log g(E) += ln H(E) for the energies of the last production stage, and the histogram is cleared
+
+    inline const double& ln_f() const{ return _ln_f;}
+
+    inline const long int& E_min() const{ return _E_min;}
+
+    inline const long int& E_max() const{ return _E_max;}
+
+    inline size_t bins() const{ return _log_g.size();} //bin b holds the energy E_min + 2b
+
+    inline const std::vector<double>& log_g() const{ return _log_g;} //up to a constant
+
+    inline const std::vector<uint64_t>& histogram() const{ return _H;}
+
+    inline const std::vector<uint8_t>& visited() const{ return _visited;} //energies that were ever reached
+
+    inline const std::vector<uint64_t>& samples() const{ return _samples;} //production measurements of each energy
+
+    inline const std::vector<double>& abs_M() const{ return _abs_M;} //sums of |M|, M^2 and M^4 over the production measurements of each energy
+
+    inline const std::vector<double>& M2() const{ return _M2;}
+
+    inline const std::vector<double>& M4() const{ return _M4;}
+
+    inline double energy() const{ return _E;}
+
+    inline double magnetization() const{ return _M;}
+
+    const SpinState& ising_state() const{
+        return static_cast<const SpinState&>(this->state());
+    }
+
+    void save(BinaryWriter& out) const override;
+
+    void load(BinaryReader& in) override;
+
+    size_t memory() const override;
+
+private:
+
+    long int _E_min, _E_max;
+    long int _E, _M; //running energy and magnetization
+    double _ln_f = 1;
+    std::vector<double> _log_g;
+    std::vector<uint64_t> _H;
+    std::vector<uint8_t> _visited;
+    std::vector<uint64_t> _samples;
+    std::vector<double> _abs_M, _M2, _M4;
+    std::uniform_int_distribution<size_t> _spin_roulette;
+
+    inline size_t _bin(const long int& E) const{ return (E - _E_min)/2;}
+
+    inline bool _inside(const long int& E) const{ return E >= _E_min && E <= _E_max;}
+
+    long int _delta(const size_t& k) const; //energy change of flipping spin k, 2*s*(sum of neighbors)
+
+    template<bool Muca>
+    void _step();
+
+    void _enter_window();
+
+    void _allocate();
+};
+
+
+class DensityOfStates{
+
+    /*
+    Density of states g(E) of a lattice with N sites, normalized so that it sums to 2^N (exact if the energies cover the whole spectrum),
+    and the microcanonical averages <|M|>_E, <M^2>_E, <M^4>_E (NaN where they were never measured).
+    Thermal averages follow at any temperature, with log_Z the absolute log of the partition function.
+    The magnetic averages only use the energies that have measurements.
+    */
+
+public:
+
+    DensityOfStates(const std::vector<double>& E, const std::vector<double>& log_g, const size_t& N, const std::vector<double>& abs_M, const std::vector<double>& M2, const std::vector<double>& M4);
+
+    ReweightedPoint at(const double& T) const;
+
+    std::vector<ReweightedPoint> curve(const std::vector<double>& T, int threads=-1) const; //all temperatures in parallel
+
+    inline const std::vector<double>& energies() const{ return _E;}
+
+    inline const std::vector<double>& log_g() const{ return _log_g;}
+
+    inline const std::vector<double>& abs_M() const{ return _abs_M;}
+
+    inline const std::vector<double>& M2() const{ return _M2;}
+
+    inline const std::vector<double>& M4() const{ return _M4;}
+
+    inline size_t N() const{ return _N;}
+
+private:
+
+    std::vector<double> _E, _log_g, _abs_M, _M2, _M4;
+    size_t _N;
+};
+
+
+class WangLandau{
+
+    /*
+    Flat-histogram sampling of a periodic Lx x Ly Ising lattice, with the energy range split in overlapping windows
+    (overlap: fraction of a window shared with the next one) that are sampled by independent walkers in parallel.
+    run() performs the Wang-Landau stages of every window: after each check_sweeps sweeps the histogram is tested for flatness,
+    and a flat histogram halves ln_f, until ln_f < final_ln_f.
+    Wang-Landau alone saturates at a finite accuracy (the weights keep changing), so production() then samples with fixed
+    multicanonical weights, refines them with the recursion log g += ln H, and measures the microcanonical magnetization.
+    Its error decreases with the number of round trips of the walkers through their windows.
+    density_of_states() joins the windows, each one shifted to match the previous one at the overlapping energy where the slopes of log g agree best.
+    */
+
+public:
+
+    WangLandau(const size_t& Lx, const size_t& Ly, const size_t& windows=1, const double& overlap=0.5); //the whole spectrum [-2N, 2N]
+
+    WangLandau(const size_t& Lx, const size_t& Ly, const long int& E_min, const long int& E_max, const size_t& windows=1, const double& overlap=0.5);
+
+    inline size_t windows() const{ return _chains.size();}
+
+    inline const WangLandauChain& window(const size_t& k) const{ return _chains.at(k);}
+
+    inline size_t sites() const{ return _N;}
+
+    bool run(const double& flatness=0.8, const double& final_ln_f=1e-6, const size_t& check_sweeps=100, const size_t& max_sweeps=0, int threads=-1); //max_sweeps per window, 0 for no limit. Returns false if a window did not reach final_ln_f
+
+    void production(const size_t& sweeps, const size_t& iterations=1, int threads=-1); //iterations of sweeps sweeps per window, each one followed by the multicanonical recursion
+
+    DensityOfStates density_of_states() const;
+
+    void set_counting(const bool& on);
+
+    ChainCounters counters() const; //sum over the windows
+
+private:
+
+    size_t _N;
+    long int _E_min, _E_max;
+    std::vector<WangLandauChain> _chains;
+};
+
+
+#endif